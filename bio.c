@@ -1,6 +1,6 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
@@ -17,79 +17,287 @@
 // * B_VALID: the buffer data has been read from the disk.
 // * B_DIRTY: the buffer data has been modified
 //     and needs to be written to disk.
+//
+// Buffers are found by hashing (dev, blockno) into one of
+// NBUCKET chains, each with its own spin-lock, so lookups of
+// different blocks rarely contend.  A bucket's lock protects
+// its chain and the refcnt of the buffers on it.
+//
+// Replacement is kept apart from lookup: a clock hand sweeps
+// the buffers, giving a second chance to buffers used since
+// it last passed (b->recent) and recycling the first idle,
+// clean buffer after that.  Only a miss takes bcache.lock,
+// which serializes recycling; hits never do.
+// Lock order: bcache.lock, then a bucket lock, then kmem.lock.
+//
+// The cache has NBUF buffers of its own and grows by whole
+// kalloc pages of buffers (up to NBUFPAGE pages) on misses
+// while free memory is plentiful.  When kalloc() runs low it
+// calls breclaim(), which hands idle pages back.
 
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "mmu.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "sysinfo.h"
 
-struct {
+#define NBUCKET 127
+#define BPP     (PGSIZE / sizeof(struct buf))  // buffers per page
+#define NSLOT   (NBUF + NBUFPAGE*BPP)         // clock positions
+#define BFREE   ((uint)-1)  // dev of a buffer holding no block
+
+struct bucket {
   struct spinlock lock;
+  struct buf *head;
+  uint hits;
+};
+
+struct {
+  struct spinlock lock;  // serializes misses, growth and the clock
   struct buf buf[NBUF];
+  struct buf *page[NBUFPAGE];  // grown pages, BPP buffers each
+  int npages;
+  int nfree;             // buffers holding no block
+  int hand;              // next clock position to inspect
+  uint misses;
+  uint evictions;
+  uint grows;
+  uint shrinks;
+  uint readahead;
 
-  // Linked list of all buffers, through prev/next.
-  // head.next is most recently used.
-  struct buf head;
+  struct bucket bucket[NBUCKET];
 } bcache;
 
+static struct bucket*
+bhash(uint dev, uint blockno)
+{
+  return &bcache.bucket[(dev*31 + blockno) % NBUCKET];
+}
+
 void
 binit(void)
 {
   struct buf *b;
+  struct bucket *bk;
 
   initlock(&bcache.lock, "bcache");
+  for(bk = bcache.bucket; bk < bcache.bucket+NBUCKET; bk++)
+    initlock(&bk->lock, "bcache.bucket");
 
 //PAGEBREAK!
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
+  // Free buffers are on no chain; a miss gives them a block.
   for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
     initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    b->dev = BFREE;
   }
+  bcache.nfree = NBUF;
 }
 
-// Look through buffer cache for block on device dev.
-// If not found, allocate a buffer.
-// In either case, return locked buffer.
+// Find the cached buffer for (dev, blockno) in bk and take
+// a reference to it.  Caller holds bk->lock.
 static struct buf*
-bget(uint dev, uint blockno)
+bfind(struct bucket *bk, uint dev, uint blockno)
 {
   struct buf *b;
 
-  acquire(&bcache.lock);
-
-  // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
+  for(b = bk->head; b; b = b->next){
     if(b->dev == dev && b->blockno == blockno){
       b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
       return b;
     }
   }
+  return 0;
+}
+
+// Unlink b from bucket bk.  Caller holds bk->lock.
+static void
+bunlink(struct bucket *bk, struct buf *b)
+{
+  struct buf **pp;
+
+  for(pp = &bk->head; *pp; pp = &(*pp)->next){
+    if(*pp == b){
+      *pp = b->next;
+      b->next = 0;
+      return;
+    }
+  }
+  panic("bunlink");
+}
+
+// Return the buffer under the clock hand and advance the
+// hand, skipping page slots the cache has not grown into.
+// Caller holds bcache.lock.
+static struct buf*
+bclock(void)
+{
+  int i;
+
+  for(;;){
+    i = bcache.hand;
+    if(i < NBUF){
+      bcache.hand++;
+      return &bcache.buf[i];
+    }
+    if(i >= NSLOT){
+      bcache.hand = 0;
+      continue;
+    }
+    i -= NBUF;
+    if(bcache.page[i/BPP] == 0){
+      bcache.hand = NBUF + (i/BPP + 1)*BPP;
+      continue;
+    }
+    bcache.hand++;
+    return &bcache.page[i/BPP][i%BPP];
+  }
+}
+
+// Memory is plentiful and every buffer holds a block:
+// add a page of free buffers and point the clock at it
+// so the next misses use them.  Returns 0 if the cache
+// can't or shouldn't grow.  Caller holds bcache.lock.
+static int
+bgrow(void)
+{
+  struct buf *b;
+  int k, i;
+
+  for(k = 0; k < NBUFPAGE; k++)
+    if(bcache.page[k] == 0)
+      break;
+  if(k == NBUFPAGE || kfreepages() < ktotalpages()/4)
+    return 0;
+  if((b = (struct buf*)kalloc()) == 0)
+    return 0;
+  memset(b, 0, PGSIZE);
+  for(i = 0; i < BPP; i++){
+    initsleeplock(&b[i].lock, "buffer");
+    b[i].dev = BFREE;
+  }
+  bcache.page[k] = b;
+  bcache.npages++;
+  bcache.nfree += BPP;
+  bcache.grows++;
+  bcache.hand = NBUF + k*BPP;
+  return 1;
+}
+
+// Advance the clock hand to a free buffer, or to an idle,
+// clean one that has not been used since the hand last
+// passed, and unlink it from its bucket.  Returns 0 if
+// every buffer is in use.  Caller holds bcache.lock.
+static struct buf*
+bvictim(void)
+{
+  struct buf *b;
+  struct bucket *bk;
+  int i;
+
+  if(bcache.nfree == 0)
+    bgrow();
+  for(i = 0; i < 2*(NBUF + bcache.npages*BPP); i++){
+    b = bclock();
+    if(b->dev == BFREE){
+      bcache.nfree--;
+      b->refcnt = 1;
+      return b;
+    }
+
+    bk = bhash(b->dev, b->blockno);
+    acquire(&bk->lock);
+    // Even if refcnt==0, B_DIRTY indicates a buffer is in use
+    // because log.c has modified it but not yet committed it.
+    if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0){
+      if(b->recent)
+        b->recent = 0;
+      else {
+        bunlink(bk, b);
+        b->refcnt = 1;
+        release(&bk->lock);
+        if(b->flags & B_VALID)
+          bcache.evictions++;
+        return b;
+      }
+    }
+    release(&bk->lock);
+  }
+  return 0;
+}
+
+// Look through buffer cache for block on device dev.
+// If not found, allocate a buffer.
+// In either case, return the buffer referenced but unlocked,
+// or 0 if there is no buffer to allocate.
+static struct buf*
+bref(uint dev, uint blockno)
+{
+  struct buf *b;
+  struct bucket *bk;
+
+  bk = bhash(dev, blockno);
+
+  // Is the block already cached?
+  acquire(&bk->lock);
+  if((b = bfind(bk, dev, blockno)) != 0)
+    bk->hits++;
+  release(&bk->lock);
+  if(b)
+    return b;
 
-  // Not cached; recycle an unused buffer.
-  // Even if refcnt==0, B_DIRTY indicates a buffer is in use
-  // because log.c has modified it but not yet committed it.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0) {
+  // Not cached.  Misses are serialized by bcache.lock, so
+  // after checking again nobody else can add this block
+  // before we do.
+  acquire(&bcache.lock);
+  acquire(&bk->lock);
+  b = bfind(bk, dev, blockno);
+  release(&bk->lock);
+  if(b == 0){
+    bcache.misses++;
+    // Recycle a buffer.  It is off every chain while it
+    // changes identity, so no lookup can see it half-done.
+    if((b = bvictim()) != 0){
       b->dev = dev;
       b->blockno = blockno;
       b->flags = 0;
-      b->refcnt = 1;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
+      acquire(&bk->lock);
+      b->next = bk->head;
+      bk->head = b;
+      release(&bk->lock);
     }
   }
-  panic("bget: no buffers");
+  release(&bcache.lock);
+  return b;
+}
+
+// Return a locked buffer for block on device dev.
+static struct buf*
+bget(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  if((b = bref(dev, blockno)) == 0)
+    panic("bget: no buffers");
+  acquiresleep(&b->lock);
+  return b;
+}
+
+// Drop a reference to a buffer that is not locked.
+// Mark it recently used so the clock passes it over once.
+static void
+bput(struct buf *b)
+{
+  struct bucket *bk;
+
+  bk = bhash(b->dev, b->blockno);
+  acquire(&bk->lock);
+  b->refcnt--;
+  b->recent = 1;
+  release(&bk->lock);
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -105,6 +313,43 @@ bread(uint dev, uint blockno)
   return b;
 }
 
+// Start reading a block into the cache without waiting,
+// for read-ahead.  Does nothing if the block is cached,
+// someone is using its buffer, or every buffer is in use;
+// only bget() panics for want of one.  The buffer stays
+// locked while the disk works, so a bread() of the block
+// waits for the data; the driver then calls biodone().
+void
+breadahead(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  if((b = bref(dev, blockno)) == 0)
+    return;
+  if(!tryacquiresleep(&b->lock)){
+    bput(b);
+    return;
+  }
+  if(b->flags & B_VALID){
+    brelse(b);
+    return;
+  }
+  bcache.readahead++;
+  b->flags |= B_ASYNC;
+  idesubmit(b);
+}
+
+// Called by the disk driver, possibly from an interrupt,
+// when an asynchronous request for b has finished.
+// Unlock b and drop the submitter's reference.
+void
+biodone(struct buf *b)
+{
+  b->flags &= ~B_ASYNC;
+  releasesleep(&b->lock);
+  bput(b);
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
@@ -115,8 +360,27 @@ bwrite(struct buf *b)
   iderw(b);
 }
 
+// Start writing b to disk without waiting, so that a batch
+// of writes to neighbouring blocks can go out as one disk
+// command.  Must be locked; finish with bwait() before
+// releasing b.
+void
+bwritestart(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("bwritestart");
+  b->flags |= B_DIRTY;
+  idesubmit(b);
+}
+
+// Wait for a write started by bwritestart() to finish.
+void
+bwait(struct buf *b)
+{
+  idecomplete(b);
+}
+
 // Release a locked buffer.
-// Move to the head of the MRU list.
 void
 brelse(struct buf *b)
 {
@@ -124,21 +388,88 @@ brelse(struct buf *b)
     panic("brelse");
 
   releasesleep(&b->lock);
+  bput(b);
+}
 
+// Detach b from its block if it is idle and clean, making
+// it free.  Returns 0 if b is in use.
+// Caller holds bcache.lock.
+static int
+bdetach(struct buf *b)
+{
+  struct bucket *bk;
+
+  if(b->dev == BFREE)
+    return 1;
+  bk = bhash(b->dev, b->blockno);
+  acquire(&bk->lock);
+  if(b->refcnt != 0 || (b->flags & B_DIRTY)){
+    release(&bk->lock);
+    return 0;
+  }
+  bunlink(bk, b);
+  b->dev = BFREE;
+  b->flags = 0;
+  bcache.nfree++;
+  release(&bk->lock);
+  return 1;
+}
+
+// Called by kalloc() when free memory runs low: give grown
+// pages back, newest first, until free memory is healthy
+// again.  A page goes back only if every buffer on it is
+// idle and clean.  Returns the number of pages freed.
+int
+breclaim(void)
+{
+  struct buf *pg;
+  int k, i, n;
+
+  // kalloc() from bgrow(); we already hold the cache.
+  if(holding(&bcache.lock))
+    return 0;
+
+  n = 0;
   acquire(&bcache.lock);
-  b->refcnt--;
-  if (b->refcnt == 0) {
-    // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+  for(k = NBUFPAGE-1; k >= 0; k--){
+    if(kfreepages() >= ktotalpages()/8)
+      break;
+    if((pg = bcache.page[k]) == 0)
+      continue;
+    for(i = 0; i < BPP; i++)
+      if(!bdetach(&pg[i]))
+        break;
+    if(i < BPP)
+      continue;
+    bcache.page[k] = 0;
+    bcache.npages--;
+    bcache.nfree -= BPP;
+    bcache.shrinks++;
+    kfree((char*)pg);
+    n++;
   }
-  
   release(&bcache.lock);
+  return n;
+}
+
+// Report buffer cache size and activity.
+void
+bcachestats(struct bcacheinfo *st)
+{
+  struct bucket *bk;
+
+  acquire(&bcache.lock);
+  st->nbuf = NBUF + bcache.npages*BPP;
+  st->npages = bcache.npages;
+  st->misses = bcache.misses;
+  st->evictions = bcache.evictions;
+  st->grows = bcache.grows;
+  st->shrinks = bcache.shrinks;
+  st->readahead = bcache.readahead;
+  release(&bcache.lock);
+  st->hits = 0;
+  for(bk = bcache.bucket; bk < bcache.bucket+NBUCKET; bk++)
+    st->hits += bk->hits;
 }
 //PAGEBREAK!
 // Blank page.
-
@@ -4,11 +4,13 @@ struct buf {
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
-  struct buf *next;
+  struct buf *next;  // hash bucket chain
+  int recent;        // used since the eviction clock last passed?
   struct buf *qnext; // disk queue
+  uint qtime;        // ticks when queued for the disk
   uchar data[BSIZE];
 };
 #define B_VALID 0x2  // buffer has been read from disk
 #define B_DIRTY 0x4  // buffer needs to be written to disk
+#define B_ASYNC 0x8  // no one waits; driver calls biodone() when done
 
@@ -11,10 +11,17 @@ struct stat;
 struct superblock;
 
 // bio.c
+struct bcacheinfo;
+void            bcachestats(struct bcacheinfo*);
 void            binit(void);
+void            biodone(struct buf*);
 struct buf*     bread(uint, uint);
+void            breadahead(uint, uint);
+int             breclaim(void);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+void            bwritestart(struct buf*);
+void            bwait(struct buf*);
 
 // console.c
 void            consoleinit(void);
@@ -24,6 +31,8 @@ void            panic(char*) __attribute__((noreturn));
 
 // exec.c
 int             exec(char*, char**);
+struct image;
+int             loadimage(char*, char**, struct image*);
 
 // file.c
 struct file*    filealloc(void);
@@ -35,28 +44,39 @@ int             filestat(struct file*, struct stat*);
 int             filewrite(struct file*, char*, int n);
 
 // fs.c
+struct fsinfo;
 void            readsb(int dev, struct superblock *sb);
+void            fsstats(struct fsinfo*);
 int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
+void            dirunlink(struct inode*, char*, uint);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
+void            itext(struct inode*, int);
 void            iinit(int dev);
 void            ilock(struct inode*);
 void            iput(struct inode*);
 void            iunlock(struct inode*);
 void            iunlockput(struct inode*);
 void            iupdate(struct inode*);
+void            iflush(void);
 int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
+int             readbufs(struct inode*, char*, uint, uint);
 int             readi(struct inode*, char*, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, char*, uint, uint);
 
 // ide.c
+struct ideinfo;
 void            ideinit(void);
 void            ideintr(void);
 void            iderw(struct buf*);
+void            idesubmit(struct buf*);
+void            idecomplete(struct buf*);
+int             setiosched(int);
+void            idestats(struct ideinfo*);
 
 // ioapic.c
 void            ioapicenable(int irq, int cpu);
@@ -66,6 +86,8 @@ void            ioapicinit(void);
 // kalloc.c
 char*           kalloc(void);
 void            kfree(char*);
+void            kref(char*);
+int             krefcount(char*);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
 int             kfreepages(void);
@@ -80,23 +102,44 @@ int             lapicid(void);
 extern volatile uint*    lapic;
 void            lapiceoi(void);
 void            lapicinit(void);
+void            lapicipi(int, int);
 void            lapicstartap(uchar, uint);
 void            microdelay(int);
 
 // log.c
+struct loginfo;
 void            initlog(int dev);
 void            log_write(struct buf*);
 void            begin_op();
+void            begin_opn(int);
 void            end_op();
+void            end_opn(int);
+int             log_opmax(void);
+void            log_sync(void);
+void            logstats(struct loginfo*);
 
 // mp.c
 extern int      ismp;
 void            mpinit(void);
 
+// pci.c
+struct pcidev;
+int             pcifind(struct pcidev*, int, int, int, int);
+uint            pciiobar(struct pcidev*, int);
+uint            pciread(struct pcidev*, int);
+void            pciwrite(struct pcidev*, int, uint);
+
 // picirq.c
 void            picenable(int);
 void            picinit(void);
 
+// pcache.c
+void            pcinit(void);
+char*           pcget(struct inode*, uint);
+void            pcwrite(struct inode*, uint, char*, uint);
+void            pcdrop(struct inode*);
+int             pcreclaim(void);
+
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
@@ -108,16 +151,22 @@ int             pipewrite(struct pipe*, char*, int);
 int             cpuid(void);
 void            exit(void);
 int             fork(void);
+int             getlevel(int);
 int             growproc(int);
 int             kill(int);
+void            kproc(char*, void (*)(void));
+void            mlfqboost(void);
 struct cpu*     mycpu(void);
 struct proc*    myproc();
 void            pinit(void);
 void            procdump(void);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
+int             schedtick(void);
+int             setlevel(int, int);
 void            setproc(struct proc*);
 void            sleep(void*, struct spinlock*);
+int             spawn(char*, char**, struct file**);
 void            userinit(void);
 int             wait(void);
 void            wakeup(void*);
@@ -139,6 +188,7 @@ void            popcli(void);
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
+int             tryacquiresleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
 
 // sysmon.c - Kernel Status Monitoring
@@ -172,6 +222,7 @@ char*           strncpy(char*, const char*, int);
 // syscall.c
 int             argint(int, int*);
 int             argptr(int, char**, int);
+int             argoutptr(int, char**, int);
 int             argstr(int, char**);
 int             fetchint(uint, int*);
 int             fetchstr(uint, char**);
@@ -202,6 +253,10 @@ void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
 int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
 pde_t*          copyuvm(pde_t*, uint);
+int             pgfault(uint, uint);
+int             uvmready(uint, uint, int);
+struct meminfo;
+void            faultstats(struct meminfo*);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
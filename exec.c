@@ -7,8 +7,12 @@
 #include "x86.h"
 #include "elf.h"
 
+// Load the program in path into a new page table, with
+// argv on its stack, for exec() or spawn().  Segments laid
+// out for it are left for page faults to read in from the
+// file; the rest are read now.  Returns 0 on success.
 int
-exec(char *path, char **argv)
+loadimage(char *path, char **argv, struct image *im)
 {
   char *s, *last;
   int i, off;
@@ -16,8 +20,11 @@ exec(char *path, char **argv)
   struct elfhdr elf;
   struct inode *ip;
   struct proghdr ph;
-  pde_t *pgdir, *oldpgdir;
-  struct proc *curproc = myproc();
+  struct seg *sg;
+  pde_t *pgdir;
+
+  im->exe = 0;
+  im->nseg = 0;
 
   begin_op();
 
@@ -49,6 +56,24 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr + ph.memsz < ph.vaddr)
       goto bad;
+    if(ph.vaddr < sz || ph.vaddr + ph.memsz >= KERNBASE)
+      goto bad;
+
+    // A segment whose pages line up with the file's, and
+    // that shares no page with the one before, is paged in
+    // on demand.
+    if(ph.vaddr % PGSIZE == ph.off % PGSIZE &&
+       PGROUNDDOWN(ph.vaddr) >= PGROUNDUP(sz) && im->nseg < NSEG){
+      sg = &im->seg[im->nseg++];
+      sg->va = PGROUNDDOWN(ph.vaddr);
+      sg->off = ph.off - (ph.vaddr - sg->va);
+      sg->fend = ph.vaddr + ph.filesz;
+      sg->end = ph.vaddr + ph.memsz;
+      sg->writable = (ph.flags & ELF_PROG_FLAG_WRITE) != 0;
+      sz = sg->end;
+      continue;
+    }
+
     if((sz = allocuvm(pgdir, sz, ph.vaddr + ph.memsz)) == 0)
       goto bad;
     if(ph.vaddr % PGSIZE != 0)
@@ -56,7 +81,14 @@ exec(char *path, char **argv)
     if(loaduvm(pgdir, (char*)ph.vaddr, ip, ph.off, ph.filesz) < 0)
       goto bad;
   }
-  iunlockput(ip);
+  // Counted under the lock, so no write is half done.
+  if(im->nseg > 0){
+    itext(ip, 1);
+    im->exe = ip;
+  }
+  iunlock(ip);
+  if(im->exe == 0)
+    iput(ip);
   end_op();
   ip = 0;
 
@@ -87,20 +119,16 @@ exec(char *path, char **argv)
   if(copyout(pgdir, sp, ustack, (3+argc+1)*4) < 0)
     goto bad;
 
-  // Save program name for debugging.
+  // Name the program, for debugging.
   for(last=s=path; *s; s++)
     if(*s == '/')
       last = s+1;
-  safestrcpy(curproc->name, last, sizeof(curproc->name));
+  im->name = last;
 
-  // Commit to the user image.
-  oldpgdir = curproc->pgdir;
-  curproc->pgdir = pgdir;
-  curproc->sz = sz;
-  curproc->tf->eip = elf.entry;  // main
-  curproc->tf->esp = sp;
-  switchuvm(curproc);
-  freevm(oldpgdir);
+  im->pgdir = pgdir;
+  im->sz = sz;
+  im->entry = elf.entry;  // main
+  im->sp = sp;
   return 0;
 
  bad:
@@ -110,5 +138,45 @@ exec(char *path, char **argv)
     iunlockput(ip);
     end_op();
   }
+  if(im->exe){
+    itext(im->exe, -1);
+    begin_op();
+    iput(im->exe);
+    end_op();
+    im->exe = 0;
+  }
   return -1;
 }
+
+int
+exec(char *path, char **argv)
+{
+  struct image im;
+  struct inode *oldexe;
+  pde_t *oldpgdir;
+  struct proc *curproc = myproc();
+
+  if(loadimage(path, argv, &im) < 0)
+    return -1;
+  safestrcpy(curproc->name, im.name, sizeof(curproc->name));
+
+  // Commit to the user image.
+  oldpgdir = curproc->pgdir;
+  oldexe = curproc->exe;
+  curproc->pgdir = im.pgdir;
+  curproc->sz = im.sz;
+  curproc->exe = im.exe;
+  curproc->nseg = im.nseg;
+  memmove(curproc->seg, im.seg, sizeof(im.seg));
+  curproc->tf->eip = im.entry;
+  curproc->tf->esp = im.sp;
+  switchuvm(curproc);
+  freevm(oldpgdir);
+  if(oldexe){
+    itext(oldexe, -1);
+    begin_op();
+    iput(oldexe);
+    end_op();
+  }
+  return 0;
+}
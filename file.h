@@ -12,17 +12,28 @@ struct file {
 // in-memory copy of an inode
 struct inode {
   uint dev;           // Device number
-  uint inum;          // Inode number
+  uint inum;          // Inode number, or 0 if entry is empty
   int ref;            // Reference count
+  int ntext;          // Processes running the program in it
+  struct inode *next;   // icache hash chain
+  struct inode *lprev;  // icache LRU list, while ref is 0
+  struct inode *lnext;
+  int dirty;            // iupdate() since the last commit?
+  struct inode *dnext;  // icache dirty list
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
+  uint ranext;        // block a sequential reader reads next
+  uint raend;         // last block read ahead
+  uint rawin;         // read-ahead window, in blocks
 
   short type;         // copy of disk inode
   short major;
   short minor;
   short nlink;
   uint size;
-  uint addrs[NDIRECT+1];
+  struct extent ext[NEXTENT];
+  uint extblock;
+  uint dextblock;
 };
 
 // table mapping major device number to
@@ -20,9 +20,12 @@
 #include "fs.h"
 #include "buf.h"
 #include "file.h"
+#include "sysinfo.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 static void itrunc(struct inode*);
+static void dinit(void);
+static void dpurge(uint, uint);
 // there should be one superblock per disk device, but we run with
 // only one device
 struct superblock sb; 
@@ -51,30 +54,235 @@ bzero(int dev, int bno)
 }
 
 // Blocks.
+//
+// The allocator keeps a summary of the bitmap in memory:
+// bsum.nfree[n] counts the free blocks under bitmap block n,
+// so a search skips full bitmap blocks without reading them.
+// A search starts at a goal, normally the block after the
+// file's last extent, else where the last search ended.
+// When a file starts a new extent, balloc looks for a run of
+// PREALLOC free blocks and holds the rest of the run for the
+// file's next appends, so they extend the extent.  Held
+// blocks are not marked on disk; other files pass them by
+// until the file's last reference goes.  A hold is made and
+// honored with its bitmap block's buffer locked, so a run
+// never crosses bitmap blocks.
+
+#define NRESV 16  // files that can hold blocks at once
 
-// Allocate a zeroed disk block.
-static uint
-balloc(uint dev)
+struct {
+  struct spinlock lock;
+  ushort *nfree;      // free blocks under each bitmap block
+  uint nbmap;         // number of bitmap blocks
+  uint rotor;         // bitmap block the last search ended in
+  struct {
+    struct inode *ip;
+    uint start;       // blocks start..end-1 are held for ip
+    uint end;
+  } resv[NRESV];
+  int nextresv;       // hold to drop when all are in use
+} bsum;
+
+// Build the free-space summary from the bitmap.
+static void
+bsuminit(int dev)
 {
-  int b, bi, m;
   struct buf *bp;
+  uint n, bi;
+
+  initlock(&bsum.lock, "bsum");
+  bsum.nbmap = (sb.size + BPB - 1) / BPB;
+  if(bsum.nbmap > MAXBMAPBLOCKS ||
+     (bsum.nfree = (ushort*)kalloc()) == 0)
+    panic("bsuminit");
+  for(n = 0; n < bsum.nbmap; n++){
+    bsum.nfree[n] = 0;
+    bp = bread(dev, sb.bmapstart + n);
+    for(bi = 0; bi < BPB && n*BPB + bi < sb.size; bi++)
+      if((bp->data[bi/8] & (1 << (bi%8))) == 0)
+        bsum.nfree[n]++;
+    brelse(bp);
+  }
+}
 
-  bp = 0;
-  for(b = 0; b < sb.size; b += BPB){
-    bp = bread(dev, BBLOCK(b, sb));
-    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
-      m = 1 << (bi % 8);
-      if((bp->data[bi/8] & m) == 0){  // Is block free?
-        bp->data[bi/8] |= m;  // Mark block in use.
+// Report the file system's size and free blocks.
+void
+fsstats(struct fsinfo *st)
+{
+  uint n;
+
+  st->size = sb.size;
+  st->nblocks = sb.nblocks;
+  st->nfree = 0;
+  acquire(&bsum.lock);
+  if(bsum.nfree)
+    for(n = 0; n < bsum.nbmap; n++)
+      st->nfree += bsum.nfree[n];
+  release(&bsum.lock);
+}
+
+// Is block b held for a file other than ip?
+// Caller must hold bsum.lock.
+static int
+bheld(struct inode *ip, uint b)
+{
+  int i;
+
+  for(i = 0; i < NRESV; i++)
+    if(bsum.resv[i].ip != 0 && bsum.resv[i].ip != ip &&
+       b >= bsum.resv[i].start && b < bsum.resv[i].end)
+      return 1;
+  return 0;
+}
+
+// Hold blocks start..end-1 for ip instead of what it held.
+// Caller must hold bsum.lock.
+static void
+bhold(struct inode *ip, uint start, uint end)
+{
+  int i, slot;
+
+  slot = -1;
+  for(i = 0; i < NRESV; i++){
+    if(bsum.resv[i].ip == ip){
+      slot = i;
+      break;
+    }
+    if(bsum.resv[i].ip == 0 && slot < 0)
+      slot = i;
+  }
+  if(start >= end){
+    if(slot >= 0 && bsum.resv[slot].ip == ip)
+      bsum.resv[slot].ip = 0;
+    return;
+  }
+  if(slot < 0){
+    slot = bsum.nextresv;
+    bsum.nextresv = (slot + 1) % NRESV;
+  }
+  bsum.resv[slot].ip = ip;
+  bsum.resv[slot].start = start;
+  bsum.resv[slot].end = end;
+}
+
+// Give up the blocks held for ip.
+static void
+bunhold(struct inode *ip)
+{
+  acquire(&bsum.lock);
+  bhold(ip, 0, 0);
+  release(&bsum.lock);
+}
+
+// Give up every file's held blocks.  Returns 0 if
+// none were held.
+static int
+bunholdall(void)
+{
+  int i, n;
+
+  n = 0;
+  acquire(&bsum.lock);
+  for(i = 0; i < NRESV; i++){
+    if(bsum.resv[i].ip != 0){
+      bsum.resv[i].ip = 0;
+      n++;
+    }
+  }
+  release(&bsum.lock);
+  return n;
+}
+
+// Mark block b in use in bp, its bitmap block.
+// Caller must hold bsum.lock.
+static void
+btake(struct buf *bp, uint b)
+{
+  uint bi;
+
+  bi = b % BPB;
+  bp->data[bi/8] |= 1 << (bi%8);
+  bsum.nfree[b/BPB]--;
+}
+
+// Allocate a zeroed disk block for ip, at or after block
+// goal if it can (0 for no preference).  If run > 1, look
+// first for run free blocks in a row and hold the rest of
+// them for ip.  Blocks held for other files are used only
+// when there are no others.  Returns 0 if the disk is full.
+static uint
+balloc(struct inode *ip, uint goal, uint run)
+{
+  struct buf *bp;
+  uint k, n, bi, b, len, want;
+
+  if(goal == 0 || goal >= sb.size)
+    goal = bsum.rotor * BPB;
+  for(want = run; ; want = 1){
+    for(k = 0; k <= bsum.nbmap; k++){
+      n = (goal/BPB + k) % bsum.nbmap;
+      if(bsum.nfree[n] < want)  // a hint, checked below
+        continue;
+      bp = bread(ip->dev, sb.bmapstart + n);
+      acquire(&bsum.lock);
+      len = 0;
+      for(bi = k == 0 ? goal%BPB : 0; bi < BPB && n*BPB + bi < sb.size; bi++){
+        if((bp->data[bi/8] & (1 << (bi%8))) || bheld(ip, n*BPB + bi))
+          len = 0;
+        else if(++len == want)
+          break;
+      }
+      if(len == want){
+        b = n*BPB + bi - (want - 1);
+        btake(bp, b);
+        if(run > 1)
+          bhold(ip, b + 1, b + want);
+        bsum.rotor = n;
+        release(&bsum.lock);
         log_write(bp);
         brelse(bp);
-        bzero(dev, b + bi);
-        return b + bi;
+        bzero(ip->dev, b);
+        return b;
       }
+      release(&bsum.lock);
+      brelse(bp);
     }
+    if(want == 1 && bunholdall() == 0)
+      break;
+  }
+  return 0;
+}
+
+// Allocate block b for ip, zeroed, if it is free and not
+// held for another file.  Returns b, or 0.
+static uint
+ballocat(struct inode *ip, uint b)
+{
+  int i, bi, m;
+  struct buf *bp;
+
+  if(b >= sb.size)
+    return 0;
+  bp = bread(ip->dev, BBLOCK(b, sb));
+  bi = b % BPB;
+  m = 1 << (bi % 8);
+  acquire(&bsum.lock);
+  if((bp->data[bi/8] & m) || bheld(ip, b)){
+    release(&bsum.lock);
     brelse(bp);
+    return 0;
   }
-  panic("balloc: out of blocks");
+  btake(bp, b);
+  for(i = 0; i < NRESV; i++)
+    if(bsum.resv[i].ip == ip && bsum.resv[i].start == b){
+      bhold(ip, b + 1, bsum.resv[i].end);
+      break;
+    }
+  release(&bsum.lock);
+  log_write(bp);
+  brelse(bp);
+  bzero(ip->dev, b);
+  return b;
 }
 
 // Free a disk block.
@@ -90,10 +298,42 @@ bfree(int dev, uint b)
   if((bp->data[bi/8] & m) == 0)
     panic("freeing free block");
   bp->data[bi/8] &= ~m;
+  acquire(&bsum.lock);
+  bsum.nfree[b/BPB]++;
+  release(&bsum.lock);
   log_write(bp);
   brelse(bp);
 }
 
+// Free the n disk blocks starting at b.
+static void
+bfreerun(int dev, uint b, uint n)
+{
+  struct buf *bp;
+  int bi, m;
+  uint nb;
+
+  while(n > 0){
+    bp = bread(dev, BBLOCK(b, sb));
+    nb = 0;
+    do {
+      bi = b % BPB;
+      m = 1 << (bi % 8);
+      if((bp->data[bi/8] & m) == 0)
+        panic("freeing free block");
+      bp->data[bi/8] &= ~m;
+      b++;
+      n--;
+      nb++;
+    } while(n > 0 && b % BPB != 0);
+    acquire(&bsum.lock);
+    bsum.nfree[(b-1)/BPB] += nb;
+    release(&bsum.lock);
+    log_write(bp);
+    brelse(bp);
+  }
+}
+
 // Inodes.
 //
 // An inode describes a single unnamed file.
@@ -130,7 +370,9 @@ bfree(int dev, uint b)
 //   cache entry is only correct when ip->valid is 1.
 //   ilock() reads the inode from
 //   the disk and sets ip->valid, while iput() clears
-//   ip->valid if ip->ref has fallen to zero.
+//   ip->valid when it frees the inode.  An entry whose
+//   ref has fallen to zero stays valid until iget()
+//   reuses it for another inode.
 //
 // * Locked: file system code may only examine and modify
 //   the information in an inode and its content if it
@@ -154,28 +396,102 @@ bfree(int dev, uint b)
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 //
+// The cache is a hash table of entries chained through
+// ip->next by (dev, inum).  Entries with ref 0 sit on an LRU
+// list (ip->lprev, ip->lnext) and keep their inode, so a
+// file opened again finds its inode valid without reading
+// the dinode.  A miss takes the entry at the head of the
+// list: an empty one, or else the least recently released.
+// There are NINODE entries to start with; while memory is
+// plentiful, a miss that finds no empty entry adds a kalloc
+// page of them (up to NINODEPAGE pages) instead of evicting.
+//
 // The icache.lock spin-lock protects the allocation of icache
 // entries. Since ip->ref indicates whether an entry is free,
 // and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold icache.lock while using any of those fields.
+// holds, one must hold icache.lock while using any of those
+// fields, or the hash chains and the LRU list.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
-// dev, and inum.  One must hold ip->lock in order to
-// read or write that inode's ip->valid, ip->size, ip->type, &c.
+// dev, inum, and the list pointers.  One must hold ip->lock in
+// order to read or write that inode's ip->valid, ip->size,
+// ip->type, &c.
+
+#define NIHASH 61
+#define IPP    (PGSIZE / sizeof(struct inode))  // entries per page
 
 struct {
   struct spinlock lock;
   struct inode inode[NINODE];
+  struct inode *hash[NIHASH];
+  struct inode lru;     // lru.lnext is reused first
+  struct inode *dirty;  // inodes iflush() has yet to copy, by dnext
+  int npages;
 } icache;
 
+static struct inode**
+ihash(uint dev, uint inum)
+{
+  return &icache.hash[(dev*31 + inum) % NIHASH];
+}
+
+// Put ip, which has no references, on the LRU list: at the
+// tail if it holds an inode worth keeping, else at the head.
+// Caller must hold icache.lock.
+static void
+ilruput(struct inode *ip, int keep)
+{
+  struct inode *at;
+
+  at = keep ? icache.lru.lprev : &icache.lru;
+  ip->lprev = at;
+  ip->lnext = at->lnext;
+  at->lnext->lprev = ip;
+  at->lnext = ip;
+}
+
+// Take ip off the LRU list.  Caller must hold icache.lock.
+static void
+ilrutake(struct inode *ip)
+{
+  ip->lprev->lnext = ip->lnext;
+  ip->lnext->lprev = ip->lprev;
+  ip->lprev = ip->lnext = 0;
+}
+
+// Add a page of empty entries to the head of the LRU list.
+// Returns 0 if the cache can't or shouldn't grow.
+// Caller must hold icache.lock.
+static int
+igrow(void)
+{
+  struct inode *ip;
+  int i;
+
+  if(icache.npages == NINODEPAGE || kfreepages() < ktotalpages()/4)
+    return 0;
+  if((ip = (struct inode*)kalloc()) == 0)
+    return 0;
+  memset(ip, 0, PGSIZE);
+  for(i = 0; i < IPP; i++){
+    initsleeplock(&ip[i].lock, "inode");
+    ilruput(&ip[i], 0);
+  }
+  icache.npages++;
+  return 1;
+}
+
 void
 iinit(int dev)
 {
   int i = 0;
   
   initlock(&icache.lock, "icache");
+  dinit();
+  icache.lru.lprev = icache.lru.lnext = &icache.lru;
   for(i = 0; i < NINODE; i++) {
     initsleeplock(&icache.inode[i].lock, "inode");
+    ilruput(&icache.inode[i], 0);
   }
 
   readsb(dev, &sb);
@@ -183,6 +499,7 @@ iinit(int dev)
  inodestart %d bmap start %d\n", sb.size, sb.nblocks,
           sb.ninodes, sb.nlog, sb.logstart, sb.inodestart,
           sb.bmapstart);
+  bsuminit(dev);
 }
 
 static struct inode* iget(uint dev, uint inum);
@@ -213,12 +530,37 @@ ialloc(uint dev, short type)
   panic("ialloc: no inodes");
 }
 
-// Copy a modified in-memory inode to disk.
+// Note that a modified in-memory inode must go to disk.
 // Must be called after every change to an ip->xxx field
-// that lives on disk, since i-node cache is write-through.
+// that lives on disk, inside a transaction.  The first call
+// in a transaction logs the inode's block; the copy into it
+// waits for iflush() at commit, so an inode updated many
+// times, or many inodes in one block, cost one copy each.
 // Caller must hold ip->lock.
 void
 iupdate(struct inode *ip)
+{
+  struct buf *bp;
+
+  acquire(&icache.lock);
+  if(ip->dirty){
+    release(&icache.lock);
+    return;
+  }
+  ip->dirty = 1;
+  ip->dnext = icache.dirty;
+  icache.dirty = ip;
+  release(&icache.lock);
+
+  bp = bread(ip->dev, IBLOCK(ip->inum, sb));
+  log_write(bp);
+  brelse(bp);
+}
+
+// Copy ip into its disk block, which iupdate() logged in
+// ip's transaction.
+static void
+iwrite(struct inode *ip)
 {
   struct buf *bp;
   struct dinode *dip;
@@ -230,42 +572,103 @@ iupdate(struct inode *ip)
   dip->minor = ip->minor;
   dip->nlink = ip->nlink;
   dip->size = ip->size;
-  memmove(dip->addrs, ip->addrs, sizeof(ip->addrs));
-  log_write(bp);
+  memmove(dip->ext, ip->ext, sizeof(ip->ext));
+  dip->extblock = ip->extblock;
+  dip->dextblock = ip->dextblock;
   brelse(bp);
 }
 
+// Copy every inode iupdate() marked into its disk block,
+// which the closing transaction already holds.  Called by
+// the flusher while no FS system call is active, so the
+// inodes cannot change underneath.
+void
+iflush(void)
+{
+  struct inode *ip, *next;
+
+  acquire(&icache.lock);
+  ip = icache.dirty;
+  icache.dirty = 0;
+  release(&icache.lock);
+
+  for(; ip; ip = next){
+    iwrite(ip);
+
+    acquire(&icache.lock);
+    next = ip->dnext;
+    ip->dnext = 0;
+    ip->dirty = 0;
+    release(&icache.lock);
+  }
+}
+
 // Find the inode with number inum on device dev
 // and return the in-memory copy. Does not lock
 // the inode and does not read it from disk.
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip, **pp;
 
   acquire(&icache.lock);
 
+again:
   // Is the inode already cached?
-  empty = 0;
-  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
+  for(ip = *ihash(dev, inum); ip; ip = ip->next){
+    if(ip->dev == dev && ip->inum == inum){
+      if(ip->ref++ == 0)
+        ilrutake(ip);
       release(&icache.lock);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
   }
 
-  // Recycle an inode cache entry.
-  if(empty == 0)
-    panic("iget: no inodes");
+  // Recycle an inode cache entry, growing the cache
+  // rather than evict an inode if there is no empty one.
+  // A dirty inode stays until iflush() has copied it.
+  for(ip = icache.lru.lnext; ip != &icache.lru; ip = ip->lnext)
+    if(!ip->dirty)
+      break;
+  if((ip == &icache.lru || ip->inum != 0) && igrow())
+    ip = icache.lru.lnext;
+  if(ip == &icache.lru){
+    // Every unused entry is dirty and the cache can't grow.
+    // Waiting for iflush() would wait on this very system
+    // call, so copy the least recently used one now.  Clear
+    // dirty first: a change made meanwhile marks it again,
+    // and iflush() copies it at commit.
+    if((ip = icache.lru.lnext) == &icache.lru)
+      panic("iget: no inodes");
+    for(pp = &icache.dirty; *pp != ip; pp = &(*pp)->dnext)
+      if(*pp == 0)
+        panic("iget: outside a transaction");
+    *pp = ip->dnext;
+    ip->dnext = 0;
+    ip->dirty = 0;
+    ilrutake(ip);
+    ip->ref = 1;
+    release(&icache.lock);
+    iwrite(ip);
+    acquire(&icache.lock);
+    if(--ip->ref == 0)
+      ilruput(ip, ip->valid);
+    goto again;
+  }
+  ilrutake(ip);
+  if(ip->inum != 0){
+    for(pp = ihash(ip->dev, ip->inum); *pp != ip; pp = &(*pp)->next)
+      ;
+    *pp = ip->next;
+  }
 
-  ip = empty;
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  pp = ihash(dev, inum);
+  ip->next = *pp;
+  *pp = ip;
   release(&icache.lock);
 
   return ip;
@@ -282,6 +685,19 @@ idup(struct inode *ip)
   return ip;
 }
 
+// Count one more (n = 1) or one fewer (n = -1) process
+// running the program in ip.  writei() refuses to change
+// a file while any does, as their pages come from it.
+void
+itext(struct inode *ip, int n)
+{
+  acquire(&icache.lock);
+  ip->ntext += n;
+  if(ip->ntext < 0)
+    panic("itext");
+  release(&icache.lock);
+}
+
 // Lock the given inode.
 // Reads the inode from disk if necessary.
 void
@@ -303,8 +719,11 @@ ilock(struct inode *ip)
     ip->minor = dip->minor;
     ip->nlink = dip->nlink;
     ip->size = dip->size;
-    memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
+    memmove(ip->ext, dip->ext, sizeof(ip->ext));
+    ip->extblock = dip->extblock;
+    ip->dextblock = dip->dextblock;
     brelse(bp);
+    ip->ranext = ip->raend = ip->rawin = 0;
     ip->valid = 1;
     if(ip->type == 0)
       panic("ilock: no type");
@@ -332,12 +751,16 @@ void
 iput(struct inode *ip)
 {
   acquiresleep(&ip->lock);
-  if(ip->valid && ip->nlink == 0){
-    acquire(&icache.lock);
-    int r = ip->ref;
-    release(&icache.lock);
-    if(r == 1){
+  acquire(&icache.lock);
+  int r = ip->ref;
+  release(&icache.lock);
+  if(r == 1){
+    // Nothing will append to ip: give up its held blocks.
+    bunhold(ip);
+    if(ip->valid && ip->nlink == 0){
       // inode has no links and no other references: truncate and free.
+      if(ip->type == T_DIR)
+        dpurge(ip->dev, ip->inum);
       itrunc(ip);
       ip->type = 0;
       iupdate(ip);
@@ -347,7 +770,8 @@ iput(struct inode *ip)
   releasesleep(&ip->lock);
 
   acquire(&icache.lock);
-  ip->ref--;
+  if(--ip->ref == 0)
+    ilruput(ip, ip->valid);
   release(&icache.lock);
 }
 
@@ -363,40 +787,162 @@ iunlockput(struct inode *ip)
 // Inode content
 //
 // The content (data) associated with each inode is stored
-// in blocks on the disk. The first NDIRECT block numbers
-// are listed in ip->addrs[].  The next NINDIRECT blocks are
-// listed in block ip->addrs[NDIRECT].
+// in extents, runs of consecutive blocks on the disk.  The
+// first NEXTENT extents are listed in ip->ext[], the next
+// NIEXTENT in block ip->extblock, and the rest in the up to
+// NINDIRECT extent blocks listed in block ip->dextblock.
+// Each extent carries on where the one before it ends; one
+// with len 0 ends the list, and an extent block is only
+// allocated to hold an extent.  Appending a block grows the
+// last extent when the disk block after it is free, so a
+// file written in one go usually maps with a few extents.
+
+// Allocate the block after extent e, if e is not empty
+// and that block is free.  Returns it, or 0.
+static uint
+extend(struct inode *ip, struct extent *e)
+{
+  if(e == 0 || e->len == 0 || ballocat(ip, e->start + e->len) == 0)
+    return 0;
+  return e->start + e->len++;
+}
 
-// Return the disk block address of the nth block in inode ip.
-// If there is no such block, bmap allocates one.
+// Allocate block bn, the first past the end of the file,
+// into the free extent slot e after last.  A new extent
+// starts as near after last as there is room to grow it;
+// if e is the first in its extent block, near goal, where
+// the extent before it ends.
 static uint
-bmap(struct inode *ip, uint bn)
+append(struct inode *ip, struct extent *last, struct extent *e, uint goal)
 {
-  uint addr, *a;
-  struct buf *bp;
+  uint addr;
 
-  if(bn < NDIRECT){
-    if((addr = ip->addrs[bn]) == 0)
-      ip->addrs[bn] = addr = balloc(ip->dev);
+  if((addr = extend(ip, last)) != 0)
     return addr;
+  if(last)
+    goal = last->start + last->len;
+  if((addr = balloc(ip, goal, PREALLOC)) == 0)
+    return 0;
+  e->start = addr;
+  e->len = 1;
+  return addr;
+}
+
+// Look for file block bn in the n extents at e, the first
+// of which starts at file block *off.  Returns the index of
+// the extent holding bn, or of the first empty extent, or n;
+// *off is left at the start of that extent.
+static int
+extscan(struct extent *e, int n, uint bn, uint *off)
+{
+  int i;
+
+  for(i = 0; i < n && e[i].len; i++){
+    if(bn < *off + e[i].len)
+      break;
+    *off += e[i].len;
   }
-  bn -= NDIRECT;
+  return i;
+}
 
-  if(bn < NINDIRECT){
-    // Load indirect block, allocating if necessary.
-    if((addr = ip->addrs[NDIRECT]) == 0)
-      ip->addrs[NDIRECT] = addr = balloc(ip->dev);
-    bp = bread(ip->dev, addr);
-    a = (uint*)bp->data;
-    if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);
-      log_write(bp);
+// Return the disk block address of the nth block in inode ip.
+// If there is no such block, bmap allocates one; bn must
+// then be the first block past the end of the file.
+// Returns 0 if the file has no extent left to grow, or
+// the disk is full.
+static uint
+bmap(struct inode *ip, uint bn)
+{
+  uint off, addr, goal, *a;
+  struct extent *e;
+  struct buf *bp, *dbp;
+  int c, i, n;
+
+  off = 0;
+  addr = 0;
+  goal = 0;
+  bp = dbp = 0;
+  e = ip->ext;
+  n = NEXTENT;
+  for(c = 0; ; c++){
+    i = extscan(e, n, bn, &off);
+    if(i < n && e[i].len){
+      addr = e[i].start + bn - off;
+      break;
     }
-    brelse(bp);
-    return addr;
+    if(i < n){
+      // The list ends in this block of extents.
+      if(bn != off)
+        panic("bmap: out of range");
+      addr = append(ip, i > 0 ? &e[i-1] : 0, &e[i], goal);
+      if(bp)
+        log_write(bp);
+      break;
+    }
+
+    // These extents are full; find the next block of them.
+    // Extent block c is listed at c-1 in the dextblock.
+    goal = e[n-1].start + e[n-1].len;
+    a = 0;
+    if(c == 0)
+      a = &ip->extblock;
+    else if(c <= NINDIRECT && ip->dextblock){
+      if(dbp == 0)
+        dbp = bread(ip->dev, ip->dextblock);
+      a = (uint*)dbp->data + c - 1;
+    }
+    if(a == 0 || *a == 0){
+      // The list ends here: grow the last extent, or
+      // allocate the next extent block to start a new one.
+      if(bn != off)
+        panic("bmap: out of range");
+      if((addr = extend(ip, &e[n-1])) != 0){
+        if(bp)
+          log_write(bp);
+        break;
+      }
+      if(c > NINDIRECT)
+        break;
+      if(a == 0){
+        if((ip->dextblock = balloc(ip, goal, 1)) == 0)
+          break;
+        dbp = bread(ip->dev, ip->dextblock);
+        a = (uint*)dbp->data + c - 1;
+      }
+      if((*a = balloc(ip, goal, 1)) == 0)
+        break;
+      if(dbp)
+        log_write(dbp);
+    }
+    if(bp)
+      brelse(bp);
+    bp = bread(ip->dev, *a);
+    e = (struct extent*)bp->data;
+    n = NIEXTENT;
   }
+  if(bp)
+    brelse(bp);
+  if(dbp)
+    brelse(dbp);
+  return addr;
+}
 
-  panic("bmap: out of range");
+// Free the runs listed in extent block addr, and the block.
+static void
+extfree(struct inode *ip, uint addr)
+{
+  struct buf *bp;
+  struct extent *e;
+  int i;
+
+  bp = bread(ip->dev, addr);
+  e = (struct extent*)bp->data;
+  for(i = 0; i < NIEXTENT; i++){
+    if(e[i].len)
+      bfreerun(ip->dev, e[i].start, e[i].len);
+  }
+  brelse(bp);
+  bfree(ip->dev, addr);
 }
 
 // Truncate inode (discard contents).
@@ -407,27 +953,32 @@ bmap(struct inode *ip, uint bn)
 static void
 itrunc(struct inode *ip)
 {
-  int i, j;
+  int i;
   struct buf *bp;
   uint *a;
 
-  for(i = 0; i < NDIRECT; i++){
-    if(ip->addrs[i]){
-      bfree(ip->dev, ip->addrs[i]);
-      ip->addrs[i] = 0;
-    }
+  pcdrop(ip);
+  for(i = 0; i < NEXTENT; i++){
+    if(ip->ext[i].len)
+      bfreerun(ip->dev, ip->ext[i].start, ip->ext[i].len);
+    ip->ext[i].start = ip->ext[i].len = 0;
   }
 
-  if(ip->addrs[NDIRECT]){
-    bp = bread(ip->dev, ip->addrs[NDIRECT]);
+  if(ip->extblock){
+    extfree(ip, ip->extblock);
+    ip->extblock = 0;
+  }
+
+  if(ip->dextblock){
+    bp = bread(ip->dev, ip->dextblock);
     a = (uint*)bp->data;
-    for(j = 0; j < NINDIRECT; j++){
-      if(a[j])
-        bfree(ip->dev, a[j]);
+    for(i = 0; i < NINDIRECT; i++){
+      if(a[i])
+        extfree(ip, a[i]);
     }
     brelse(bp);
-    bfree(ip->dev, ip->addrs[NDIRECT]);
-    ip->addrs[NDIRECT] = 0;
+    bfree(ip->dev, ip->dextblock);
+    ip->dextblock = 0;
   }
 
   ip->size = 0;
@@ -446,20 +997,91 @@ stati(struct inode *ip, struct stat *st)
   st->size = ip->size;
 }
 
+// Sequential read-ahead.
+//
+// readi() tells readahead() about every block it is about
+// to read.  When the reads are sequential, the blocks after
+// it are handed to the disk without waiting, so they are
+// (or are becoming) valid by the time readi() gets to them.
+// The window doubles, up to RAMAX, each time readi() reaches
+// a block that was read ahead, and halves when the reader
+// jumps away and leaves read-ahead blocks unused.
+#define RAMIN 2
+
+// Caller must hold ip->lock.
+static void
+readahead(struct inode *ip, uint bn)
+{
+  uint b, last;
+
+  if(bn + 1 == ip->ranext)
+    return;                      // still in the same block
+  if(bn == ip->ranext && ip->rawin > 0){
+    if(bn <= ip->raend && ip->rawin < RAMAX)
+      ip->rawin *= 2;            // read-ahead paid off
+  } else if(bn == ip->ranext){
+    ip->rawin = RAMIN;           // looks like a sequential reader
+  } else {
+    if(ip->raend >= ip->ranext)  // read-ahead went unused
+      ip->rawin /= 2;
+    ip->raend = bn;
+  }
+  ip->ranext = bn + 1;
+
+  if(ip->rawin == 0)
+    return;
+  last = bn + ip->rawin;
+  if(last >= (ip->size + BSIZE - 1) / BSIZE)
+    last = (ip->size + BSIZE - 1) / BSIZE - 1;
+  // Every block below ip->size exists, so bmap() only looks.
+  for(b = (ip->raend > bn ? ip->raend : bn) + 1; b <= last; b++)
+    breadahead(ip->dev, bmap(ip, b));
+  if(last > ip->raend)
+    ip->raend = last;
+}
+
 //PAGEBREAK!
-// Read data from inode.
+// Read data from the inode's blocks, through the buffer
+// cache; the page cache fills its pages this way.
 // Caller must hold ip->lock.
 int
-readi(struct inode *ip, char *dst, uint off, uint n)
+readbufs(struct inode *ip, char *dst, uint off, uint n)
 {
   uint tot, m;
   struct buf *bp;
 
+  if(off > ip->size || off + n < off)
+    return -1;
+  if(off + n > ip->size)
+    n = ip->size - off;
+
+  for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
+    readahead(ip, off/BSIZE);
+    bp = bread(ip->dev, bmap(ip, off/BSIZE));
+    m = min(n - tot, BSIZE - off%BSIZE);
+    memmove(dst, bp->data + off%BSIZE, m);
+    brelse(bp);
+  }
+  return n;
+}
+
+// Read data from inode.  A file's data comes a page at
+// a time from the page cache; directories, which change
+// a block at a time, read their blocks directly.
+// Caller must hold ip->lock.
+int
+readi(struct inode *ip, char *dst, uint off, uint n)
+{
+  uint tot, m;
+  char *pg;
+
   if(ip->type == T_DEV){
     if(ip->major < 0 || ip->major >= NDEV || !devsw[ip->major].read)
       return -1;
     return devsw[ip->major].read(ip, dst, n);
   }
+  if(ip->type != T_FILE)
+    return readbufs(ip, dst, off, n);
 
   if(off > ip->size || off + n < off)
     return -1;
@@ -467,10 +1089,14 @@ readi(struct inode *ip, char *dst, uint off, uint n)
     n = ip->size - off;
 
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
-    m = min(n - tot, BSIZE - off%BSIZE);
-    memmove(dst, bp->data + off%BSIZE, m);
-    brelse(bp);
+    m = min(n - tot, PGSIZE - off%PGSIZE);
+    if((pg = pcget(ip, PGROUNDDOWN(off))) == 0){
+      // No memory for a page: read around the cache.
+      readbufs(ip, dst, off, m);
+      continue;
+    }
+    memmove(dst, pg + off%PGSIZE, m);
+    kfree(pg);
   }
   return n;
 }
@@ -481,7 +1107,7 @@ readi(struct inode *ip, char *dst, uint off, uint n)
 int
 writei(struct inode *ip, char *src, uint off, uint n)
 {
-  uint tot, m;
+  uint tot, m, addr;
   struct buf *bp;
 
   if(ip->type == T_DEV){
@@ -494,20 +1120,31 @@ writei(struct inode *ip, char *src, uint off, uint n)
     return -1;
   if(off + n > MAXFILE*BSIZE)
     return -1;
+  acquire(&icache.lock);
+  if(ip->ntext > 0){
+    release(&icache.lock);
+    return -1;
+  }
+  release(&icache.lock);
 
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
+    if((addr = bmap(ip, off/BSIZE)) == 0)
+      break;
+    bp = bread(ip->dev, addr);
     m = min(n - tot, BSIZE - off%BSIZE);
     memmove(bp->data + off%BSIZE, src, m);
+    if(ip->type == T_FILE)
+      pcwrite(ip, off, (char*)bp->data + off%BSIZE, m);
     log_write(bp);
     brelse(bp);
   }
 
-  if(n > 0 && off > ip->size){
+  if(tot > 0 && off > ip->size)
     ip->size = off;
-    iupdate(ip);
-  }
-  return n;
+  // bmap() may have added an extent block even if the
+  // disk then filled up.
+  iupdate(ip);
+  return tot;
 }
 
 //PAGEBREAK!
@@ -519,31 +1156,413 @@ namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
+// Directory name cache.
+//
+// dcache remembers what dirlookup() found: for a name in
+// directory dir, the inum and offset of its entry, or inum 0
+// if the directory has no such name.  Entries are hashed by
+// (dev, dir, name) and reused in clock order, skipping ones
+// used since the hand last passed.  dirlink() and
+// dirunlink() keep entries current, and iput() drops the
+// entries of a directory it frees.  All of these run with
+// the directory locked, so an entry cannot change between
+// a lookup and the caller's use of it.
+
+#define NDHASH 61
+
+struct dentry {
+  uint dev;
+  uint dir;             // inum of directory; 0 if entry unused
+  uint inum;            // 0 if the name is not in dir
+  uint off;             // offset of the dirent, if inum != 0
+  int used;             // looked up since the clock hand passed
+  char name[DIRSIZ];
+  struct dentry *next;  // hash chain
+};
+
+struct {
+  struct spinlock lock;
+  struct dentry entry[NDCACHE];
+  struct dentry *hash[NDHASH];
+  int hand;             // next entry the clock looks at
+} dcache;
+
+static void
+dinit(void)
+{
+  initlock(&dcache.lock, "dcache");
+}
+
+static uint
+dhash(uint dev, uint dir, char *name)
+{
+  uint h;
+  int i;
+
+  h = dev*31 + dir;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = h*31 + (uchar)name[i];
+  return h % NDHASH;
+}
+
+// Find the entry for name in directory dir.
+// Caller must hold dcache.lock.
+static struct dentry*
+dfind(uint dev, uint dir, char *name)
+{
+  struct dentry *d;
+
+  for(d = dcache.hash[dhash(dev, dir, name)]; d; d = d->next)
+    if(d->dev == dev && d->dir == dir && namecmp(d->name, name) == 0)
+      return d;
+  return 0;
+}
+
+// Take d off its hash chain and mark it unused.
+// Caller must hold dcache.lock.
+static void
+dunhash(struct dentry *d)
+{
+  struct dentry **pp;
+
+  for(pp = &dcache.hash[dhash(d->dev, d->dir, d->name)]; *pp; pp = &(*pp)->next){
+    if(*pp == d){
+      *pp = d->next;
+      break;
+    }
+  }
+  d->dir = 0;
+}
+
+// Remember that name in directory dp is inode inum, with its
+// dirent at off; inum 0 records that dp has no such name.
+static void
+dremember(struct inode *dp, char *name, uint inum, uint off)
+{
+  struct dentry *d;
+  uint h;
+
+  acquire(&dcache.lock);
+  if((d = dfind(dp->dev, dp->inum, name)) == 0){
+    for(;;){
+      d = &dcache.entry[dcache.hand];
+      dcache.hand = (dcache.hand + 1) % NDCACHE;
+      if(d->dir == 0 || !d->used)
+        break;
+      d->used = 0;
+    }
+    if(d->dir)
+      dunhash(d);
+    d->dev = dp->dev;
+    d->dir = dp->inum;
+    strncpy(d->name, name, DIRSIZ);
+    h = dhash(d->dev, d->dir, d->name);
+    d->next = dcache.hash[h];
+    dcache.hash[h] = d;
+  }
+  d->inum = inum;
+  d->off = off;
+  d->used = 0;
+  release(&dcache.lock);
+}
+
+// Forget every name in directory dir, which is being freed.
+static void
+dpurge(uint dev, uint dir)
+{
+  int i;
+
+  acquire(&dcache.lock);
+  for(i = 0; i < NDCACHE; i++)
+    if(dcache.entry[i].dir == dir && dcache.entry[i].dev == dev)
+      dunhash(&dcache.entry[i]);
+  release(&dcache.lock);
+}
+
+// Hashed directories.
+//
+// A directory starts as a plain array of dirents.  When one
+// outgrows its first block, dirlink() turns it into a hashed
+// directory (see fs.h), so a lookup reads the table and one
+// leaf however big the directory gets.  A full leaf splits in
+// two by the next bit of its names' hashes, doubling the
+// table when the leaf already uses all of the table's bits.
+// Directories that grew past a block before hashing existed
+// stay plain arrays.
+
+static uint
+dirhash(char *name)
+{
+  uint h;
+  int i;
+
+  h = 2166136261;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = (h ^ (uchar)name[i]) * 16777619;
+  return h;
+}
+
+// Is dp a hashed directory?
+static int
+dirhashed(struct inode *dp)
+{
+  struct dirhdr hd;
+
+  if(dp->size < 2*BSIZE)
+    return 0;
+  if(readi(dp, (char*)&hd, 0, sizeof(hd)) != sizeof(hd))
+    panic("dirhashed read");
+  return hd.zero == 0 && hd.magic == DIRMAGIC;
+}
+
+// Return the leaf of hashed directory dp for hash h.
+static uint
+dirleaf(struct inode *dp, uint h)
+{
+  struct dirhdr hd;
+  struct dirtab t;
+  uint i;
+
+  if(readi(dp, (char*)&hd, 0, sizeof(hd)) != sizeof(hd))
+    panic("dirleaf read");
+  i = h & ((1 << hd.depth) - 1);
+  if(readi(dp, (char*)&t, (1 + i/DTABSLOTS)*sizeof(t), sizeof(t)) != sizeof(t))
+    panic("dirleaf read");
+  return t.leaf[i % DTABSLOTS];
+}
+
+// Search the dirents of dp between start and end for name.
+// Returns its inum and sets *poff, or returns 0.
+static uint
+dirscan(struct inode *dp, char *name, uint start, uint end, uint *poff)
+{
+  uint off;
+  struct dirent de;
+
+  for(off = start; off < end; off += sizeof(de)){
+    if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
+      panic("dirlookup read");
+    if(de.inum != 0 && namecmp(name, de.name) == 0){
+      *poff = off;
+      return de.inum;
+    }
+  }
+  return 0;
+}
+
+// Return the offset of the first empty dirent of dp between
+// start and end, or end if there is none.
+static uint
+dirfree(struct inode *dp, uint start, uint end)
+{
+  uint off;
+  struct dirent de;
+
+  for(off = start; off < end; off += sizeof(de)){
+    if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
+      panic("dirlink read");
+    if(de.inum == 0)
+      break;
+  }
+  return off;
+}
+
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
 struct inode*
 dirlookup(struct inode *dp, char *name, uint *poff)
 {
-  uint off, inum;
-  struct dirent de;
+  uint off, inum, leaf;
+  struct dentry *d;
 
   if(dp->type != T_DIR)
     panic("dirlookup not DIR");
 
-  for(off = 0; off < dp->size; off += sizeof(de)){
-    if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlookup read");
-    if(de.inum == 0)
-      continue;
-    if(namecmp(name, de.name) == 0){
-      // entry matches path element
-      if(poff)
-        *poff = off;
-      inum = de.inum;
-      return iget(dp->dev, inum);
+  acquire(&dcache.lock);
+  if((d = dfind(dp->dev, dp->inum, name)) != 0){
+    d->used = 1;
+    inum = d->inum;
+    off = d->off;
+    release(&dcache.lock);
+    if(inum == 0)
+      return 0;
+    if(poff)
+      *poff = off;
+    return iget(dp->dev, inum);
+  }
+  release(&dcache.lock);
+
+  if(dirhashed(dp)){
+    leaf = dirleaf(dp, dirhash(name));
+    inum = dirscan(dp, name, leaf*BSIZE + sizeof(struct dirhdr),
+                   (leaf+1)*BSIZE, &off);
+  } else
+    inum = dirscan(dp, name, 0, dp->size, &off);
+  if(inum == 0){
+    dremember(dp, name, 0, 0);
+    return 0;
+  }
+
+  // entry matches path element
+  if(poff)
+    *poff = off;
+  dremember(dp, name, inum, off);
+  return iget(dp->dev, inum);
+}
+
+// Split leaf block leaf of hashed directory dp, which is full,
+// in two.  Returns -1 if the table has no bit left to tell
+// the halves apart, or there is no memory or disk block to do
+// it in; dp is then unchanged.
+static int
+dirsplit(struct inode *dp, uint leaf)
+{
+  char *p;
+  struct dirhdr *th, *lh, *nh;
+  struct dirtab *tab;
+  struct dirent *de, *nde;
+  uint d, i, nleaf;
+
+  if((p = kalloc()) == 0)
+    return -1;
+  th = (struct dirhdr*)p;
+  lh = (struct dirhdr*)(p + BSIZE);
+  nh = (struct dirhdr*)(p + 2*BSIZE);
+  tab = (struct dirtab*)(th + 1);
+  if(readi(dp, (char*)th, 0, BSIZE) != BSIZE ||
+     readi(dp, (char*)lh, leaf*BSIZE, BSIZE) != BSIZE)
+    panic("dirsplit read");
+
+  d = lh->depth;
+  if(d == th->depth){
+    if(d == DIRDEPTH){
+      kfree(p);
+      return -1;
     }
+    // Double the table: slot i + 2^d names the leaf slot i does.
+    for(i = 0; i < (1 << d); i++)
+      DTAB(tab, i + (1 << d)) = DTAB(tab, i);
+    th->depth++;
   }
 
+  // Names with bit d set move to a new leaf at the end.
+  nleaf = dp->size / BSIZE;
+  memset(nh, 0, BSIZE);
+  nh->magic = DIRMAGIC;
+  nh->depth = lh->depth = d + 1;
+  nde = (struct dirent*)(nh + 1);
+  for(de = (struct dirent*)(lh + 1); de < (struct dirent*)nh; de++){
+    if(de->inum != 0 && (dirhash(de->name) >> d) & 1){
+      *nde++ = *de;
+      memset(de, 0, sizeof(*de));
+    }
+  }
+  for(i = 0; i < (1 << th->depth); i++)
+    if(DTAB(tab, i) == leaf && (i >> d) & 1)
+      DTAB(tab, i) = nleaf;
+
+  // Only the new leaf needs a block.
+  if(writei(dp, (char*)nh, nleaf*BSIZE, BSIZE) != BSIZE){
+    kfree(p);
+    return -1;
+  }
+  if(writei(dp, (char*)lh, leaf*BSIZE, BSIZE) != BSIZE ||
+     writei(dp, (char*)th, 0, BSIZE) != BSIZE)
+    panic("dirsplit write");
+  kfree(p);
+
+  // Names that moved have new offsets.
+  dpurge(dp->dev, dp->inum);
+  return 0;
+}
+
+// Write the dirent (name, inum) at off in dp.
+// Returns -1 if off is past dp's blocks and the disk is full.
+static int
+dirput(struct inode *dp, char *name, uint inum, uint off)
+{
+  struct dirent de;
+
+  memset(&de, 0, sizeof(de));
+  strncpy(de.name, name, DIRSIZ);
+  de.inum = inum;
+  if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
+    return -1;
+  dremember(dp, name, inum, off);
+  return 0;
+}
+
+// Add (name, inum) to hashed directory dp, splitting the
+// leaf for name if it is full and *nsplit allows.  Each split
+// adds a block to the caller's transaction, so dirlink()
+// allows one; a leaf still full after it is treated as a
+// full directory.
+static int
+dirinsert(struct inode *dp, char *name, uint inum, int *nsplit)
+{
+  uint h, leaf, off, end;
+
+  h = dirhash(name);
+  for(;;){
+    leaf = dirleaf(dp, h);
+    end = (leaf+1)*BSIZE;
+    if((off = dirfree(dp, leaf*BSIZE + sizeof(struct dirhdr), end)) < end)
+      return dirput(dp, name, inum, off);
+    if(*nsplit <= 0 || dirsplit(dp, leaf) < 0)
+      return -1;
+    (*nsplit)--;
+  }
+}
+
+// Turn dp, a plain directory of one full block, into a
+// hashed directory with the same names.  Returns -1 if
+// there is no memory or the disk fills up; dp is then
+// still a plain directory with the same names.  Splits
+// count against *nsplit, as in dirinsert().
+static int
+dirconvert(struct inode *dp, int *nsplit)
+{
+  char *p;
+  struct dirhdr *hd;
+  struct dirent *de;
+  uint off;
+
+  if((p = kalloc()) == 0)
+    return -1;
+  if(readi(dp, p, 0, BSIZE) != BSIZE)
+    panic("dirconvert read");
+
+  // A table whose one slot names an empty leaf at block 1.
+  hd = (struct dirhdr*)(p + BSIZE);
+  memset(hd, 0, BSIZE);
+  hd->magic = DIRMAGIC;
+  if(writei(dp, (char*)hd, BSIZE, BSIZE) != BSIZE){
+    kfree(p);
+    return -1;
+  }
+  DTAB((struct dirtab*)(hd + 1), 0) = 1;
+  if(writei(dp, (char*)hd, 0, BSIZE) != BSIZE)
+    panic("dirconvert write");
+  dpurge(dp->dev, dp->inum);
+
+  for(de = (struct dirent*)p; de < (struct dirent*)(p + BSIZE); de++)
+    if(de->inum != 0 && dirinsert(dp, de->name, de->inum, nsplit) < 0)
+      break;
+  if(de < (struct dirent*)(p + BSIZE)){
+    // A split found no free block.  Put the names back and
+    // empty the leaves, leaving a plain directory with free
+    // slots past its first block.
+    if(writei(dp, p, 0, BSIZE) != BSIZE)
+      panic("dirconvert undo");
+    memset(hd, 0, BSIZE);
+    for(off = BSIZE; off < dp->size; off += BSIZE)
+      if(writei(dp, (char*)hd, off, BSIZE) != BSIZE)
+        panic("dirconvert undo");
+    dpurge(dp->dev, dp->inum);
+    kfree(p);
+    return -1;
+  }
+  kfree(p);
   return 0;
 }
 
@@ -551,8 +1570,8 @@ dirlookup(struct inode *dp, char *name, uint *poff)
 int
 dirlink(struct inode *dp, char *name, uint inum)
 {
-  int off;
-  struct dirent de;
+  uint off;
+  int nsplit;
   struct inode *ip;
 
   // Check that name is not present.
@@ -561,20 +1580,29 @@ dirlink(struct inode *dp, char *name, uint inum)
     return -1;
   }
 
-  // Look for an empty dirent.
-  for(off = 0; off < dp->size; off += sizeof(de)){
-    if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlink read");
-    if(de.inum == 0)
-      break;
+  nsplit = 1;
+  if(!dirhashed(dp)){
+    // Look for an empty dirent; hash the directory rather
+    // than give it a second block.
+    off = dirfree(dp, 0, dp->size);
+    if(off < dp->size || dp->size != BSIZE)
+      return dirput(dp, name, inum, off);
+    if(dirconvert(dp, &nsplit) < 0)
+      return -1;
   }
+  return dirinsert(dp, name, inum, &nsplit);
+}
 
-  strncpy(de.name, name, DIRSIZ);
-  de.inum = inum;
-  if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
-    panic("dirlink");
+// Clear the directory entry for name, at off in directory dp.
+void
+dirunlink(struct inode *dp, char *name, uint off)
+{
+  struct dirent de;
 
-  return 0;
+  memset(&de, 0, sizeof(de));
+  if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
+    panic("dirunlink");
+  dremember(dp, name, 0, 0);
 }
 
 //PAGEBREAK!
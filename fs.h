@@ -21,9 +21,19 @@ struct superblock {
   uint bmapstart;    // Block number of first free map block
 };
 
-#define NDIRECT 12
+// A run of len consecutive disk blocks starting at start.
+struct extent {
+  uint start;
+  uint len;
+};
+
+#define NEXTENT 5
+#define NIEXTENT (BSIZE / sizeof(struct extent))
 #define NINDIRECT (BSIZE / sizeof(uint))
-#define MAXFILE (NDIRECT + NINDIRECT)
+#define NDEXTENT (NINDIRECT * NIEXTENT)
+// Max file size in blocks: what the runs map when each is
+// one block long, as on a badly fragmented disk.
+#define MAXFILE (NEXTENT + NIEXTENT + NDEXTENT)
 
 // On-disk inode structure
 struct dinode {
@@ -32,7 +42,10 @@ struct dinode {
   short minor;          // Minor device number (T_DEV only)
   short nlink;          // Number of links to inode in file system
   uint size;            // Size of file (bytes)
-  uint addrs[NDIRECT+1];   // Data block addresses
+  struct extent ext[NEXTENT];   // Data block runs
+  uint extblock;        // Block of NIEXTENT more runs
+  uint dextblock;       // Block of NINDIRECT more extent blocks
+  uint pad;             // Round dinode up to 64 bytes
 };
 
 // Inodes per block.
@@ -55,3 +68,31 @@ struct dirent {
   char name[DIRSIZ];
 };
 
+
+// A directory that outgrows one block is hashed: block 0 is
+// a table mapping the low depth bits of a name's hash to the
+// leaf block that holds the name, and each leaf holds
+// DPERLEAF dirents after a header.  Headers and table records
+// begin with a zero inum, so code that reads a directory as
+// an array of dirents passes over them.
+#define DIRMAGIC  0x4448  // "HD"
+#define DIRDEPTH  7       // most hash bits the table uses
+#define DTABSLOTS 7       // leaf numbers per table record
+#define DPERLEAF  (BSIZE / sizeof(struct dirent) - 1)
+
+// First record of the table and of each leaf.
+struct dirhdr {
+  ushort zero;          // Always 0
+  ushort magic;         // DIRMAGIC
+  ushort depth;         // Hash bits the table uses, or a leaf's names share
+  ushort pad[5];
+};
+
+// Records after the header in the table block.
+struct dirtab {
+  ushort zero;          // Always 0
+  ushort leaf[DTABSLOTS];       // Block of each leaf in the directory
+};
+
+// Leaf for table slot i, in the dirtabs t after the header
+#define DTAB(t, i) ((t)[(i) / DTABSLOTS].leaf[(i) % DTABSLOTS])
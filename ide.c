@@ -1,4 +1,5 @@
-// Simple PIO-based (non-DMA) IDE driver code.
+// Simple IDE driver code: bus-master DMA when the controller
+// supports it, PIO otherwise.
 
 #include "types.h"
 #include "defs.h"
@@ -12,6 +13,8 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "pci.h"
+#include "sysinfo.h"
 
 #define SECTOR_SIZE   512
 #define IDE_BSY       0x80
@@ -23,17 +26,105 @@
 #define IDE_CMD_WRITE 0x30
 #define IDE_CMD_RDMUL 0xc4
 #define IDE_CMD_WRMUL 0xc5
+#define IDE_CMD_SETMUL 0xc6
+#define IDE_CMD_RDDMA 0xc8
+#define IDE_CMD_WRDMA 0xca
+#define IDE_CMD_IDENT 0xec
+
+// Bus master registers, at the I/O base in the IDE
+// controller's BAR4 (primary channel).
+#define BM_CMD        0
+  #define BM_START      0x01
+  #define BM_READ       0x08   // transfer into memory
+#define BM_STATUS     2
+  #define BM_ERR        0x02
+  #define BM_INTR       0x04
+#define BM_PRDT       4
+
+// Physical region descriptor: one piece of memory in a
+// DMA transfer.  A piece may not cross a 64 KB boundary.
+struct prd {
+  uint addr;
+  ushort len;
+  ushort flags;
+};
+#define PRD_EOT       0x8000   // last entry
 
 // idequeue points to the buf now being read/written to the disk.
 // idequeue->qnext points to the next buf to be processed.
 // You must hold idelock while manipulating queue.
+//
+// Behind the command in progress the pending requests wait
+// in arrival order; before each command the I/O scheduler
+// picks the one to start next, and idestart() gathers the
+// requests for the blocks after it into one READ/WRITE
+// MULTIPLE command of up to MAXIOBLOCKS blocks.  idebatch
+// is the number of bufs at the head of idequeue that the
+// command in progress covers.
 
 static struct spinlock idelock;
 static struct buf *idequeue;
+static int idebatch;
 
 static int havedisk1;
+static uint idecap[2];  // size of each disk in blocks
+static int idemult;   // sectors per interrupt in READ/WRITE MULTIPLE
+static uint idebm;    // bus master registers, or 0 to use PIO
+static struct prd prdt[2*MAXIOBLOCKS] __attribute__((aligned(256)));
 static void idestart(struct buf*);
 
+static uint idepos;   // where the last command left the disk head
+static int idepolicy = IOSCHED_CLOOK;
+static struct ideinfo idestat;
+
+static uint
+idelba(struct buf *b)
+{
+  return (b->dev ? idecap[0] : 0) + b->blockno;
+}
+
+// Serve requests in arrival order.
+static struct buf**
+fifopick(struct buf **pp)
+{
+  return pp;
+}
+
+// C-LOOK elevator: the lowest block at or past the head,
+// else sweep back to the lowest block of all.
+static struct buf**
+clookpick(struct buf **pp)
+{
+  struct buf **best, **low;
+
+  best = low = 0;
+  for(; *pp; pp = &(*pp)->qnext){
+    if(low == 0 || idelba(*pp) < idelba(*low))
+      low = pp;
+    if(idelba(*pp) >= idepos && (best == 0 || idelba(*pp) < idelba(*best)))
+      best = pp;
+  }
+  return best ? best : low;
+}
+
+// C-LOOK, but a request that has waited IODEADLINE ticks
+// goes first.  The oldest request is at the head.
+static struct buf**
+deadlinepick(struct buf **pp)
+{
+  if(ticks - (*pp)->qtime >= IODEADLINE){
+    idestat.expired++;
+    return pp;
+  }
+  return clookpick(pp);
+}
+
+static struct buf **(*iosched[])(struct buf**) = {
+[IOSCHED_FIFO]     fifopick,
+[IOSCHED_CLOOK]    clookpick,
+[IOSCHED_DEADLINE] deadlinepick,
+};
+
 // Wait for IDE disk to become ready.
 static int
 idewait(int checkerr)
@@ -47,9 +138,38 @@ idewait(int checkerr)
   return 0;
 }
 
+// Ask the disk to transfer n sectors per interrupt in
+// READ/WRITE MULTIPLE.  Returns 0 if the disk refuses.
+static int
+idesetmult(int disk, int n)
+{
+  outb(0x3f6, 2);  // no interrupt for this command
+  outb(0x1f6, 0xe0 | (disk<<4));
+  outb(0x1f2, n);
+  outb(0x1f7, IDE_CMD_SETMUL);
+  return idewait(1) >= 0;
+}
+
+// Ask disk for its size with IDENTIFY DEVICE.  Returns the
+// number of blocks it can address by LBA, or 0 if it won't say.
+static uint
+ideidentify(int disk)
+{
+  uint id[SECTOR_SIZE/4];
+
+  outb(0x3f6, 2);  // no interrupt for this command
+  outb(0x1f6, 0xe0 | (disk<<4));
+  outb(0x1f7, IDE_CMD_IDENT);
+  if(idewait(1) < 0)
+    return 0;
+  insl(0x1f0, id, SECTOR_SIZE/4);
+  return id[30] / (BSIZE/SECTOR_SIZE);  // words 60-61: LBA sectors
+}
+
 void
 ideinit(void)
 {
+  struct pcidev pci;
   int i;
 
   initlock(&idelock, "ide");
@@ -65,37 +185,114 @@ ideinit(void)
     }
   }
 
+  // Requests are checked against the size of the disk, or the
+  // file system size if the disk does not give one.
+  for(i = 0; i <= havedisk1; i++)
+    if((idecap[i] = ideidentify(i)) == 0)
+      idecap[i] = FSSIZE;
+
+  // Without multiple mode every command moves one block.
+  idemult = MAXIOBLOCKS * (BSIZE/SECTOR_SIZE);
+  if((havedisk1 && !idesetmult(1, idemult)) || !idesetmult(0, idemult))
+    idemult = 0;
+
   // Switch back to disk 0.
   outb(0x1f6, 0xe0 | (0<<4));
+
+  // Use DMA if there is a PCI IDE controller that can be
+  // a bus master.
+  if(pcifind(&pci, -1, -1, 0x01, 0x01) == 0 && (pci.progif & 0x80) &&
+     (idebm = pciiobar(&pci, 4)) != 0)
+    pciwrite(&pci, PCI_CMD, pciread(&pci, PCI_CMD) | PCI_CMD_IO | PCI_CMD_MASTER);
+}
+
+// Load the PRD table with the data of the n bufs from b
+// and aim the bus master at it.
+static void
+idedmasetup(struct buf *b, int n)
+{
+  struct prd *d;
+  struct buf *p;
+  uint pa, len, chunk;
+
+  d = prdt;
+  for(p = b; n > 0; n--, p = p->qnext){
+    pa = V2P(p->data);
+    for(len = BSIZE; len > 0; len -= chunk, pa += chunk, d++){
+      chunk = 0x10000 - (pa & 0xffff);
+      if(chunk > len)
+        chunk = len;
+      d->addr = pa;
+      d->len = chunk;
+      d->flags = 0;
+    }
+  }
+  d[-1].flags = PRD_EOT;
+
+  outl(idebm + BM_PRDT, V2P(prdt));
+  outb(idebm + BM_CMD, (b->flags & B_DIRTY) ? 0 : BM_READ);
+  outb(idebm + BM_STATUS, BM_ERR | BM_INTR);
 }
 
-// Start the request for b.  Caller must hold idelock.
+// Start the request for b, at the head of idequeue, merged
+// with the pending requests for the following blocks.
+// Caller must hold idelock.
 static void
 idestart(struct buf *b)
 {
+  struct buf *p, *q, **pp;
+  int n, nsect, cmd, max;
+
   if(b == 0)
     panic("idestart");
-  if(b->blockno >= FSSIZE)
-    panic("incorrect blockno");
   int sector_per_block =  BSIZE/SECTOR_SIZE;
   int sector = b->blockno * sector_per_block;
-  int read_cmd = (sector_per_block == 1) ? IDE_CMD_READ :  IDE_CMD_RDMUL;
-  int write_cmd = (sector_per_block == 1) ? IDE_CMD_WRITE : IDE_CMD_WRMUL;
 
   if (sector_per_block > 7) panic("idestart");
+  if (sector_per_block > 1 && idemult == 0 && !idebm)
+    panic("idestart: no multiple mode");
+
+  // Move the requests this command can cover up behind b.
+  max = idebm ? MAXIOBLOCKS*sector_per_block : idemult;
+  n = 1;
+  for(p = b; (n+1)*sector_per_block <= max; p = p->qnext){
+    for(pp = &p->qnext; (q = *pp) != 0; pp = &q->qnext)
+      if(q->dev == b->dev && q->blockno == p->blockno + 1 &&
+         (q->flags & B_DIRTY) == (b->flags & B_DIRTY))
+        break;
+    if(q == 0)
+      break;
+    *pp = q->qnext;
+    q->qnext = p->qnext;
+    p->qnext = q;
+    n++;
+  }
+  idebatch = n;
+  idepos = idelba(b) + n;
+  idestat.commands++;
+  nsect = n * sector_per_block;
+
+  if(idebm)
+    idedmasetup(b, n);
 
   idewait(0);
   outb(0x3f6, 0);  // generate interrupt
-  outb(0x1f2, sector_per_block);  // number of sectors
+  outb(0x1f2, nsect);  // number of sectors
   outb(0x1f3, sector & 0xff);
   outb(0x1f4, (sector >> 8) & 0xff);
   outb(0x1f5, (sector >> 16) & 0xff);
   outb(0x1f6, 0xe0 | ((b->dev&1)<<4) | ((sector>>24)&0x0f));
-  if(b->flags & B_DIRTY){
-    outb(0x1f7, write_cmd);
-    outsl(0x1f0, b->data, BSIZE/4);
+  if(idebm){
+    outb(0x1f7, (b->flags & B_DIRTY) ? IDE_CMD_WRDMA : IDE_CMD_RDDMA);
+    outb(idebm + BM_CMD, inb(idebm + BM_CMD) | BM_START);
+  } else if(b->flags & B_DIRTY){
+    cmd = (nsect == 1) ? IDE_CMD_WRITE : IDE_CMD_WRMUL;
+    outb(0x1f7, cmd);
+    for(p = b; n-- > 0; p = p->qnext)
+      outsl(0x1f0, p->data, BSIZE/4);
   } else {
-    outb(0x1f7, read_cmd);
+    cmd = (nsect == 1) ? IDE_CMD_READ : IDE_CMD_RDMUL;
+    outb(0x1f7, cmd);
   }
 }
 
@@ -103,39 +300,91 @@ idestart(struct buf *b)
 void
 ideintr(void)
 {
-  struct buf *b;
+  struct buf *b, *done, **pp;
+  int i, ok, st;
+  uint wait;
 
-  // First queued buffer is the active request.
+  // First queued buffers are the active request.
   acquire(&idelock);
 
   if((b = idequeue) == 0){
     release(&idelock);
     return;
   }
-  idequeue = b->qnext;
 
-  // Read data if needed.
-  if(!(b->flags & B_DIRTY) && idewait(1) >= 0)
-    insl(0x1f0, b->data, BSIZE/4);
+  if(idebm){
+    // Stop the bus master; the data is already in place.
+    st = inb(idebm + BM_STATUS);
+    if(!(st & BM_INTR)){
+      release(&idelock);
+      return;
+    }
+    outb(idebm + BM_CMD, 0);
+    outb(idebm + BM_STATUS, BM_ERR | BM_INTR);
+    ok = !(st & BM_ERR) && idewait(1) >= 0;
+  } else
+    ok = idewait(1) >= 0;
 
-  // Wake process waiting for this buf.
-  b->flags |= B_VALID;
-  b->flags &= ~B_DIRTY;
-  wakeup(b);
+  // Nothing above the cache can cope with a failed read or
+  // an unwritten log block; stop here rather than pass the
+  // batch on as done.
+  if(!ok){
+    cprintf("ide: %s of blocks %d-%d failed\n",
+            (b->flags & B_DIRTY) ? "write" : "read",
+            b->blockno, b->blockno + idebatch - 1);
+    panic("ide: disk error");
+  }
 
-  // Start disk on next buf in queue.
-  if(idequeue != 0)
-    idestart(idequeue);
+  // Finish every buf the command covered, reading in the
+  // data for PIO, and wake the processes waiting for them.
+  done = 0;
+  for(i = 0; i < idebatch; i++){
+    b = idequeue;
+    idequeue = b->qnext;
+    if(!(b->flags & B_DIRTY) && !idebm)
+      insl(0x1f0, b->data, BSIZE/4);
+    b->flags |= B_VALID;
+    b->flags &= ~B_DIRTY;
+    wait = ticks - b->qtime;
+    idestat.depth--;
+    idestat.waitticks += wait;
+    if(wait > idestat.maxwait)
+      idestat.maxwait = wait;
+    if(b->flags & B_ASYNC){
+      b->qnext = done;
+      done = b;
+    } else
+      wakeup(b);
+  }
+
+  // Start disk on the buf the scheduler picks.
+  if(idequeue != 0){
+    pp = iosched[idepolicy](&idequeue);
+    b = *pp;
+    *pp = b->qnext;
+    b->qnext = idequeue;
+    idequeue = b;
+    idestart(b);
+  }
 
   release(&idelock);
+
+  // Nobody sleeps on an asynchronous request; hand it back
+  // to the buffer cache.
+  while((b = done) != 0){
+    done = b->qnext;
+    biodone(b);
+  }
 }
 
 //PAGEBREAK!
-// Sync buf with disk.
-// If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
-// Else if B_VALID is not set, read buf from disk, set B_VALID.
+// Queue b for the disk and return without waiting.
+// If B_DIRTY is set, b will be written to disk, else read.
+// Caller must hold b->lock.  If B_ASYNC is set the caller
+// gives up b and biodone() releases it when the disk is
+// done; otherwise the caller waits with idecomplete().
 void
-iderw(struct buf *b)
+idesubmit(struct buf *b)
 {
   struct buf **pp;
 
@@ -145,9 +394,18 @@ iderw(struct buf *b)
     panic("iderw: nothing to do");
   if(b->dev != 0 && !havedisk1)
     panic("iderw: ide disk 1 not present");
+  if(b->blockno >= idecap[b->dev != 0])
+    panic("iderw: block out of range");
 
   acquire(&idelock);  //DOC:acquire-lock
 
+  b->qtime = ticks;
+  idestat.requests++;
+  idestat.depth++;
+  idestat.sumdepth += idestat.depth;
+  if(idestat.depth > idestat.maxdepth)
+    idestat.maxdepth = idestat.depth;
+
   // Append b to idequeue.
   b->qnext = 0;
   for(pp=&idequeue; *pp; pp=&(*pp)->qnext)  //DOC:insert-queue
@@ -158,11 +416,60 @@ iderw(struct buf *b)
   if(idequeue == b)
     idestart(b);
 
-  // Wait for request to finish.
+  release(&idelock);
+}
+
+// Wait for the request for b queued by idesubmit() to finish:
+// B_DIRTY clear and B_VALID set.
+void
+idecomplete(struct buf *b)
+{
+  acquire(&idelock);
   while((b->flags & (B_VALID|B_DIRTY)) != B_VALID){
     sleep(b, &idelock);
   }
+  release(&idelock);
+}
+
+// Sync buf with disk.
+// If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
+// Else if B_VALID is not set, read buf from disk, set B_VALID.
+void
+iderw(struct buf *b)
+{
+  idesubmit(b);
+  idecomplete(b);
+}
 
+// Switch to I/O scheduler policy and start its statistics
+// afresh; policy -1 changes nothing.  Returns the policy in
+// use before, or -1 if policy is unknown.
+int
+setiosched(int policy)
+{
+  int old;
+  uint depth;
+
+  if(policy < -1 || policy > IOSCHED_DEADLINE)
+    return -1;
+  acquire(&idelock);
+  old = idepolicy;
+  if(policy >= 0){
+    idepolicy = policy;
+    depth = idestat.depth;
+    memset(&idestat, 0, sizeof(idestat));
+    idestat.depth = depth;
+  }
+  release(&idelock);
+  return old;
+}
 
+void
+idestats(struct ideinfo *st)
+{
+  acquire(&idelock);
+  *st = idestat;
+  st->sched = idepolicy;
+  st->dma = idebm != 0;
   release(&idelock);
 }
@@ -22,6 +22,8 @@ struct {
   int use_lock;
   struct run *freelist;
   int total_pages;  // Total pages available for allocation
+  int free_pages;   // Pages on freelist
+  ushort ref[PHYSTOP/PGSIZE];  // mappings of each allocated page
 } kmem;
 
 // Initialization happens in two phases.
@@ -35,6 +37,7 @@ kinit1(void *vstart, void *vend)
   initlock(&kmem.lock, "kmem");
   kmem.use_lock = 0;
   kmem.total_pages = 0;
+  kmem.free_pages = 0;
   freerange(vstart, vend);
 }
 
@@ -52,6 +55,7 @@ freerange(void *vstart, void *vend)
   p = (char*)PGROUNDUP((uint)vstart);
   for(; p + PGSIZE <= (char*)vend; p += PGSIZE) {
     kmem.total_pages++;  // Count total pages during init
+    kmem.ref[V2P(p)/PGSIZE] = 1;
     kfree(p);
   }
 }
@@ -60,14 +64,26 @@ freerange(void *vstart, void *vend)
 // which normally should have been returned by a
 // call to kalloc().  (The exception is when
 // initializing the allocator; see kinit above.)
+// A page shared with kref() is freed by its last kfree().
 void
 kfree(char *v)
 {
   struct run *r;
+  int ref;
 
   if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
     panic("kfree");
 
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+  if(kmem.ref[V2P(v)/PGSIZE] == 0)
+    panic("kfree: free page");
+  ref = --kmem.ref[V2P(v)/PGSIZE];
+  if(kmem.use_lock)
+    release(&kmem.lock);
+  if(ref > 0)
+    return;
+
   // Fill with junk to catch dangling refs.
   memset(v, 1, PGSIZE);
 
@@ -76,6 +92,7 @@ kfree(char *v)
   r = (struct run*)v;
   r->next = kmem.freelist;
   kmem.freelist = r;
+  kmem.free_pages++;
   if(kmem.use_lock)
     release(&kmem.lock);
 }
@@ -88,31 +105,59 @@ kalloc(void)
 {
   struct run *r;
 
+  // Running low: take back pages the buffer cache
+  // grew into while memory was plentiful, and cached
+  // program pages no process maps.
+  if(kmem.use_lock && kmem.free_pages < kmem.total_pages/16){
+    breclaim();
+    pcreclaim();
+  }
+
   if(kmem.use_lock)
     acquire(&kmem.lock);
   r = kmem.freelist;
-  if(r)
+  if(r){
     kmem.freelist = r->next;
+    kmem.free_pages--;
+    kmem.ref[V2P(r)/PGSIZE] = 1;
+  }
   if(kmem.use_lock)
     release(&kmem.lock);
   return (char*)r;
 }
 
-// Count free memory pages (for kernel monitoring)
+// Add a mapping of the allocated page v, which then takes
+// one more kfree() to free.
+void
+kref(char *v)
+{
+  if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
+    panic("kref");
+  acquire(&kmem.lock);
+  if(kmem.ref[V2P(v)/PGSIZE] == 0)
+    panic("kref: free page");
+  kmem.ref[V2P(v)/PGSIZE]++;
+  release(&kmem.lock);
+}
+
+// Number of mappings of the allocated page v.
+int
+krefcount(char *v)
+{
+  int n;
+
+  acquire(&kmem.lock);
+  n = kmem.ref[V2P(v)/PGSIZE];
+  release(&kmem.lock);
+  return n;
+}
+
+// Count free memory pages (for kernel monitoring
+// and the buffer cache's sizing decisions)
 int
 kfreepages(void)
 {
-  struct run *r;
-  int count = 0;
-  
-  if(kmem.use_lock)
-    acquire(&kmem.lock);
-  for(r = kmem.freelist; r; r = r->next)
-    count++;
-  if(kmem.use_lock)
-    release(&kmem.lock);
-  
-  return count;
+  return kmem.free_pages;
 }
 
 // Get total memory pages (for kernel monitoring)
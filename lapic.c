@@ -113,6 +113,20 @@ lapiceoi(void)
     lapicw(EOI, 0);
 }
 
+// Send a fixed interrupt with the given vector to one CPU.
+void
+lapicipi(int apicid, int vector)
+{
+  if(!lapic)
+    return;
+  pushcli();
+  lapicw(ICRHI, apicid<<24);
+  lapicw(ICRLO, FIXED | ASSERT | vector);
+  while(lapic[ICRLO] & DELIVS)
+    ;
+  popcli();
+}
+
 // Spin for a given number of microseconds.
 // On real hardware would want to tune this dynamically.
 void
@@ -5,6 +5,7 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "sysinfo.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
@@ -18,41 +19,73 @@
 // its start and end. Usually begin_op() just increments
 // the count of in-progress FS system calls and returns.
 // But if it thinks the log is close to running out, it
-// sleeps until the last outstanding end_op() commits.
+// sleeps until the flusher takes the transaction.
+//
+// Commits are group commits done by a kernel process, the
+// flusher.  When no FS system calls are active it copies the
+// transaction's blocks into private buffers and closes it;
+// new system calls then fill the next transaction while the
+// flusher writes the log, the header, installs the blocks
+// and clears the header.  Installing from the private copies
+// keeps later, uncommitted updates in the cache off the disk.
+// end_op() does not wait for the commit; log_sync() does.
 //
 // The log is a physical re-do log containing disk blocks.
 // The on-disk log format:
 //   header block, containing block #s for block A, B, C, ...
+//     and a checksum of the header and the blocks
 //   block A
 //   block B
 //   block C
 //   ...
-// Log appends are synchronous.
+// Its size comes from the superblock (mkfs -l).  The header
+// and blocks go to disk in one batch; recovery ignores a
+// header whose checksum does not match, as the crash came
+// before the whole commit was written.
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
 struct logheader {
   int n;
-  int block[LOGSIZE];
+  uint sum;
+  int block[LOGMAX];
 };
 
 struct log {
   struct spinlock lock;
   int start;
   int size;
+  int cap;         // most blocks in a transaction
   int outstanding; // how many FS sys calls are executing.
-  int committing;  // in commit(), please wait.
+  int reserved;    // blocks they may still log
+  int committing;  // flusher is closing the transaction, please wait.
   int dev;
-  struct logheader lh;
+  int absorbed;    // log_write()s absorbed in the open transaction
+  uint bmapstart;  // where the inode blocks end
+  uint datastart;  // where the bitmap blocks end
+  uint opened;     // number of the transaction being filled
+  uint flushed;    // number of the last transaction on disk
+  struct logheader lh;  // transaction being filled
+  struct logheader clh; // transaction being written
 };
 struct log log;
 
+// The flusher's copies of the committing transaction's blocks,
+// and of its header.
+static struct buf logbuf[LOGMAX];
+static struct buf headbuf;
+
+// Commit statistics, protected by log.lock.
+static struct loginfo logstat;
+
 static void recover_from_log(void);
-static void commit();
+static void flusher(void);
 
 void
 initlog(int dev)
 {
+  int i;
+
   if (sizeof(struct logheader) >= BSIZE)
     panic("initlog: too big logheader");
 
@@ -61,63 +94,140 @@ initlog(int dev)
   readsb(dev, &sb);
   log.start = sb.logstart;
   log.size = sb.nlog;
+  log.cap = log.size - 1;
+  if (log.cap > LOGMAX)
+    log.cap = LOGMAX;
+  if (log.cap < DIROPBLOCKS)
+    panic("initlog: log too small");
   log.dev = dev;
+  log.bmapstart = sb.bmapstart;
+  log.datastart = sb.bmapstart + sb.size/BPB + 1;
+  log.opened = 1;
+  logstat.size = log.size;
+  logstat.cap = log.cap;
+  initsleeplock(&headbuf.lock, "loghead");
+  for (i = 0; i < LOGMAX; i++)
+    initsleeplock(&logbuf[i].lock, "logbuf");
   recover_from_log();
+  kproc("logflush", flusher);
+}
+
+// Start reading or writing the private buffer b.
+static void
+logstart(struct buf *b, int write)
+{
+  acquiresleep(&b->lock);
+  b->dev = log.dev;
+  b->flags = write ? B_DIRTY : 0;
+  idesubmit(b);
+}
+
+static void
+logwait(struct buf *b)
+{
+  idecomplete(b);
+  releasesleep(&b->lock);
+}
+
+// Read or write the private buffers b[0..n-1], all at
+// once so the disk driver can merge neighbouring blocks.
+static void
+logio(struct buf *b, int n, int write)
+{
+  int i;
+
+  for (i = 0; i < n; i++)
+    logstart(&b[i], write);
+  for (i = 0; i < n; i++)
+    logwait(&b[i]);
+}
+
+// Checksum of header lh and the copies of its blocks.
+static uint
+logsum(struct logheader *lh)
+{
+  uint sum, *w;
+  int i, j;
+
+  sum = 2166136261 ^ lh->n;
+  for (i = 0; i < lh->n; i++) {
+    sum = (sum ^ lh->block[i]) * 16777619;
+    w = (uint*)logbuf[i].data;
+    for (j = 0; j < BSIZE/sizeof(uint); j++)
+      sum = (sum ^ w[j]) * 16777619;
+  }
+  return sum;
 }
 
-// Copy committed blocks from log to their home location
+// Write the committed blocks from the private copies to
+// their home locations.
 static void
 install_trans(void)
 {
   int tail;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    brelse(lbuf);
-    brelse(dbuf);
-  }
+  for (tail = 0; tail < log.clh.n; tail++)
+    logbuf[tail].blockno = log.clh.block[tail];
+  logio(logbuf, log.clh.n, 1);
 }
 
-// Read the log header from disk into the in-memory log header
+// Read the log header from disk into the committing header
 static void
 read_head(void)
 {
-  struct buf *buf = bread(log.dev, log.start);
-  struct logheader *lh = (struct logheader *) (buf->data);
+  struct logheader *lh = (struct logheader *) (headbuf.data);
   int i;
-  log.lh.n = lh->n;
-  for (i = 0; i < log.lh.n; i++) {
-    log.lh.block[i] = lh->block[i];
+
+  headbuf.blockno = log.start;
+  logio(&headbuf, 1, 0);
+  log.clh.n = lh->n;
+  log.clh.sum = lh->sum;
+  if (log.clh.n < 0 || log.clh.n > log.cap)
+    log.clh.n = 0;
+  for (i = 0; i < log.clh.n; i++) {
+    log.clh.block[i] = lh->block[i];
   }
-  brelse(buf);
 }
 
-// Write in-memory log header to disk.
-// This is the true point at which the
-// current transaction commits.
+// Fill in the header block from the committing header.
 static void
-write_head(void)
+fill_head(void)
 {
-  struct buf *buf = bread(log.dev, log.start);
-  struct logheader *hb = (struct logheader *) (buf->data);
+  struct logheader *hb = (struct logheader *) (headbuf.data);
   int i;
-  hb->n = log.lh.n;
-  for (i = 0; i < log.lh.n; i++) {
-    hb->block[i] = log.lh.block[i];
+
+  hb->n = log.clh.n;
+  hb->sum = logsum(&log.clh);
+  for (i = 0; i < log.clh.n; i++) {
+    hb->block[i] = log.clh.block[i];
   }
-  bwrite(buf);
-  brelse(buf);
+  headbuf.blockno = log.start;
+}
+
+// Write the committing header to disk.
+static void
+write_head(void)
+{
+  fill_head();
+  logio(&headbuf, 1, 1);
 }
 
+// Nothing else has touched the disk yet, so the cache holds
+// none of the blocks being installed.
 static void
 recover_from_log(void)
 {
+  int tail;
+
   read_head();
-  install_trans(); // if committed, copy from log to disk
-  log.lh.n = 0;
+  for (tail = 0; tail < log.clh.n; tail++)
+    logbuf[tail].blockno = log.start+tail+1;
+  logio(logbuf, log.clh.n, 0);
+  if (logsum(&log.clh) == log.clh.sum)
+    install_trans(); // if committed, copy from log to disk
+  else
+    cprintf("log: ignoring incomplete commit\n");
+  log.clh.n = 0;
   write_head(); // clear the log
 }
 
@@ -125,85 +235,215 @@ recover_from_log(void)
 void
 begin_op(void)
 {
+  begin_opn(MAXOPBLOCKS);
+}
+
+// called at the end of each FS system call.
+void
+end_op(void)
+{
+  end_opn(MAXOPBLOCKS);
+}
+
+// Most blocks one FS system call may reserve.  Leaves room
+// for another big op in the same transaction.
+int
+log_opmax(void)
+{
+  return log.cap/2 > DIROPBLOCKS ? log.cap/2 : DIROPBLOCKS;
+}
+
+// Start an FS system call that may log up to n blocks.
+void
+begin_opn(int n)
+{
+  if(n > log_opmax())
+    panic("begin_opn");
   acquire(&log.lock);
   while(1){
     if(log.committing){
       sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
-      // this op might exhaust log space; wait for commit.
+    } else if(log.lh.n + log.reserved + n > log.cap){
+      // this op might exhaust log space; wait for the flusher.
       sleep(&log, &log.lock);
     } else {
       log.outstanding += 1;
+      log.reserved += n;
       release(&log.lock);
       break;
     }
   }
 }
 
-// called at the end of each FS system call.
-// commits if this was the last outstanding operation.
+// End an FS system call started by begin_opn(n).
+// lets the flusher take the transaction if this was the
+// last outstanding operation.
 void
-end_op(void)
+end_opn(int n)
 {
-  int do_commit = 0;
-
   acquire(&log.lock);
   log.outstanding -= 1;
-  if(log.committing)
-    panic("log.committing");
-  if(log.outstanding == 0){
-    do_commit = 1;
-    log.committing = 1;
-  } else {
-    // begin_op() may be waiting for log space,
-    // and decrementing log.outstanding has decreased
-    // the amount of reserved space.
-    wakeup(&log);
-  }
+  log.reserved -= n;
+  if(log.outstanding < 0)
+    panic("end_op");
+  if(log.outstanding == 0)
+    wakeup(&log.clh);
+  // begin_op() may be waiting for log space,
+  // and decrementing log.outstanding has decreased
+  // the amount of reserved space.
+  wakeup(&log);
   release(&log.lock);
+}
 
-  if(do_commit){
-    // call commit w/o holding locks, since not allowed
-    // to sleep with locks.
-    commit();
-    acquire(&log.lock);
-    log.committing = 0;
-    wakeup(&log);
-    release(&log.lock);
+// Wait until every FS system call that has finished is
+// on disk.
+void
+log_sync(void)
+{
+  uint want;
+
+  acquire(&log.lock);
+  want = log.lh.n > 0 ? log.opened : log.opened - 1;
+  while(log.flushed < want)
+    sleep(&log.flushed, &log.lock);
+  release(&log.lock);
+}
+
+// Copy the closed transaction's blocks from the cache.
+static void
+copy_trans(void)
+{
+  int tail;
+
+  for (tail = 0; tail < log.clh.n; tail++) {
+    struct buf *from = bread(log.dev, log.clh.block[tail]); // cache block
+    memmove(logbuf[tail].data, from->data, BSIZE);
+    brelse(from);
   }
 }
 
-// Copy modified blocks from cache to log.
+// Write the header and the private copies to the log in
+// one batch.  This is the true point at which the
+// transaction commits.
 static void
 write_log(void)
 {
   int tail;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
-    brelse(from);
-    brelse(to);
+  fill_head();
+  logstart(&headbuf, 1);
+  for (tail = 0; tail < log.clh.n; tail++) {
+    logbuf[tail].blockno = log.start+tail+1;
+    logstart(&logbuf[tail], 1);
+  }
+  logwait(&headbuf);
+  for (tail = 0; tail < log.clh.n; tail++)
+    logwait(&logbuf[tail]);
+}
+
+// Let the cache evict the installed blocks again, except
+// those the next transaction has logged since.
+static void
+unpin_trans(void)
+{
+  int tail, i;
+
+  for (tail = 0; tail < log.clh.n; tail++) {
+    struct buf *b = bread(log.dev, log.clh.block[tail]);
+    acquire(&log.lock);
+    for (i = 0; i < log.lh.n; i++)
+      if (log.lh.block[i] == b->blockno)
+        break;
+    if (i == log.lh.n)
+      b->flags &= ~B_DIRTY;
+    release(&log.lock);
+    brelse(b);
   }
 }
 
 static void
-commit()
+commit(void)
 {
-  if (log.lh.n > 0) {
-    write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(); // Now install writes to home locations
+  write_log();     // Write header and copies -- the real commit
+  install_trans(); // Now install writes to home locations
+  unpin_trans();
+  log.clh.n = 0;
+  write_head();    // Erase the transaction from the log
+}
+
+// The flusher process.  Everything the FS system calls log
+// while it writes one transaction becomes the next.  Inodes
+// go into their logged blocks (iflush) only once it is closed.
+static void
+flusher(void)
+{
+  uint id, start;
+  int i, n, absorbed, ninode, nbitmap;
+
+  for(;;){
+    acquire(&log.lock);
+    while(log.lh.n == 0)
+      sleep(&log.clh, &log.lock);
+    // Close the transaction: hold back new system calls
+    // and wait for those in it to finish.
+    log.committing = 1;
+    while(log.outstanding > 0)
+      sleep(&log.clh, &log.lock);
+    // Empty the open transaction as it is closed, so
+    // log_sync() never waits for it while it is written.
+    log.clh = log.lh;
     log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+    id = log.opened++;
+    absorbed = log.absorbed;
+    log.absorbed = 0;
+    release(&log.lock);
+
+    start = ticks;
+    n = log.clh.n;
+    ninode = nbitmap = 0;
+    for(i = 0; i < n; i++){
+      if(log.clh.block[i] < log.bmapstart)
+        ninode++;
+      else if(log.clh.block[i] < log.datastart)
+        nbitmap++;
+    }
+
+    iflush();
+    copy_trans();
+
+    acquire(&log.lock);
+    log.committing = 0;
+    wakeup(&log);
+    release(&log.lock);
+
+    commit();
+
+    acquire(&log.lock);
+    log.flushed = id;
+    wakeup(&log.flushed);
+    logstat.commits++;
+    logstat.logged += n;
+    logstat.absorbed += absorbed;
+    logstat.inodeblocks += ninode;
+    logstat.bitmapblocks += nbitmap;
+    logstat.datablocks += n - ninode - nbitmap;
+    // header and copies, installs, header cleared
+    logstat.bytes += (n+1 + n + 1) * BSIZE;
+    logstat.ticks += ticks - start;
+    if(ticks - start > logstat.maxticks)
+      logstat.maxticks = ticks - start;
+    if(n > logstat.maxlogged)
+      logstat.maxlogged = n;
+    logstat.lastlogged = n;
+    logstat.lastabsorbed = absorbed;
+    logstat.lastticks = ticks - start;
+    release(&log.lock);
   }
 }
 
 // Caller has modified b->data and is done with the buffer.
 // Record the block number and pin in the cache with B_DIRTY.
-// commit()/write_log() will do the disk write.
+// The flusher will do the disk write.
 //
 // log_write() replaces bwrite(); a typical use is:
 //   bp = bread(...)
@@ -215,7 +455,7 @@ log_write(struct buf *b)
 {
   int i;
 
-  if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
+  if (log.lh.n >= log.cap)
     panic("too big a transaction");
   if (log.outstanding < 1)
     panic("log_write outside of trans");
@@ -228,7 +468,17 @@ log_write(struct buf *b)
   log.lh.block[i] = b->blockno;
   if (i == log.lh.n)
     log.lh.n++;
+  else
+    log.absorbed++;
   b->flags |= B_DIRTY; // prevent eviction
   release(&log.lock);
 }
 
+
+void
+logstats(struct loginfo *st)
+{
+  acquire(&log.lock);
+  *st = logstat;
+  release(&log.lock);
+}
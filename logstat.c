@@ -0,0 +1,83 @@
+// logstat.c - File system log statistics
+// Usage: logstat [command [args...]]
+// Without args: shows the log statistics since boot
+// With command: runs command and shows what its commits cost
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "sysinfo.h"
+
+void
+show(struct loginfo *l)
+{
+  uint blocks;
+
+  printf(1, "Log: %d blocks, %d per transaction\n", l->size, l->cap);
+  printf(1, "Commits: %d  Blocks: %d  Absorbed: %d  Bytes: %d\n",
+         l->commits, l->logged, l->absorbed, l->bytes);
+  blocks = l->logged > 0 ? l->logged : 1;
+  printf(1, "Blocks by kind: inode %d (%d%%)  bitmap %d (%d%%)  data %d (%d%%)\n",
+         l->inodeblocks, l->inodeblocks*100/blocks,
+         l->bitmapblocks, l->bitmapblocks*100/blocks,
+         l->datablocks, l->datablocks*100/blocks);
+  if(l->commits > 0)
+    printf(1, "Per commit: %d blocks, %d absorbed, %d ticks (max %d blocks, %d ticks)\n",
+           l->logged/l->commits, l->absorbed/l->commits, l->ticks/l->commits,
+           l->maxlogged, l->maxticks);
+  printf(1, "Last commit: %d blocks, %d absorbed, %d ticks\n",
+         l->lastlogged, l->lastabsorbed, l->lastticks);
+}
+
+// Counters that accumulate become the difference a - b.
+void
+diff(struct loginfo *a, struct loginfo *b)
+{
+  a->commits -= b->commits;
+  a->logged -= b->logged;
+  a->absorbed -= b->absorbed;
+  a->inodeblocks -= b->inodeblocks;
+  a->bitmapblocks -= b->bitmapblocks;
+  a->datablocks -= b->datablocks;
+  a->bytes -= b->bytes;
+  a->ticks -= b->ticks;
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct sysinfo before, after;
+  int pid, fd;
+
+  if(getsysinfo(&before) < 0){
+    printf(2, "logstat: getsysinfo failed\n");
+    exit();
+  }
+  if(argc < 2){
+    show(&before.log);
+    exit();
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf(2, "logstat: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    exec(argv[1], argv+1);
+    printf(2, "logstat: exec %s failed\n", argv[1]);
+    exit();
+  }
+  wait();
+
+  // Let the flusher finish what the command left.
+  if((fd = open(".", 0)) >= 0){
+    fsync(fd);
+    close(fd);
+  }
+  getsysinfo(&after);
+  diff(&after.log, &before.log);
+  printf(1, "--- log during %s ---\n", argv[1]);
+  show(&after.log);
+  exit();
+}
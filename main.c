@@ -30,6 +30,7 @@ main(void)
   sysmoninit();    // kernel status monitoring system
   tvinit();        // trap vectors
   binit();         // buffer cache
+  pcinit();        // page cache
   fileinit();      // file table
   ideinit();       // disk 
   startothers();   // start other processors
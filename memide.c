@@ -12,10 +12,12 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "sysinfo.h"
 
 extern uchar _binary_fs_img_start[], _binary_fs_img_size[];
 
 static int disksize;
+static int idepolicy = IOSCHED_CLOOK;
 static uchar *memdisk;
 
 void
@@ -58,3 +60,41 @@ iderw(struct buf *b)
     memmove(b->data, p, BSIZE);
   b->flags |= B_VALID;
 }
+
+// The memory disk finishes at once, so a submitted
+// request completes before returning.
+void
+idesubmit(struct buf *b)
+{
+  iderw(b);
+  if(b->flags & B_ASYNC)
+    biodone(b);
+}
+
+void
+idecomplete(struct buf *b)
+{
+  // no-op
+}
+
+// There is no queue to schedule; remember the policy so
+// callers see what they set.
+int
+setiosched(int policy)
+{
+  int old;
+
+  if(policy < -1 || policy > IOSCHED_DEADLINE)
+    return -1;
+  old = idepolicy;
+  if(policy >= 0)
+    idepolicy = policy;
+  return old;
+}
+
+void
+idestats(struct ideinfo *st)
+{
+  memset(st, 0, sizeof(*st));
+  st->sched = idepolicy;
+}
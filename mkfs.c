@@ -40,6 +40,7 @@ void rinode(uint inum, struct dinode *ip);
 void rsect(uint sec, void *buf);
 uint ialloc(ushort type);
 void iappend(uint inum, void *p, int n);
+void wdir(uint inum, struct dirent *de, int n);
 
 // convert to intel byte order
 ushort
@@ -67,26 +68,38 @@ xint(uint x)
 int
 main(int argc, char *argv[])
 {
-  int i, cc, fd;
-  uint rootino, inum, off;
-  struct dirent de;
+  int i, cc, fd, argi;
+  uint rootino, inum;
+  static struct dirent rootdir[2+NINODES];
+  int nrootdir;
   char buf[BSIZE];
-  struct dinode din;
 
 
   static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
+  static_assert(FSSIZE/(BSIZE*8) + 1 <= MAXBMAPBLOCKS, "FSSIZE too big for the log");
 
-  if(argc < 2){
-    fprintf(stderr, "Usage: mkfs fs.img files...\n");
+  argi = 1;
+  if(argc > 2 && strcmp(argv[1], "-l") == 0){
+    nlog = atoi(argv[2]);
+    argi = 3;
+  }
+  if(argc < argi+1){
+    fprintf(stderr, "Usage: mkfs [-l nlog] fs.img files...\n");
+    exit(1);
+  }
+  // The header, and no more blocks than the kernel will use.
+  if(nlog < 1+DIROPBLOCKS || nlog > 1+LOGMAX){
+    fprintf(stderr, "mkfs: log must be %d to %d blocks\n",
+            1+DIROPBLOCKS, 1+LOGMAX);
     exit(1);
   }
 
   assert((BSIZE % sizeof(struct dinode)) == 0);
   assert((BSIZE % sizeof(struct dirent)) == 0);
 
-  fsfd = open(argv[1], O_RDWR|O_CREAT|O_TRUNC, 0666);
+  fsfd = open(argv[argi], O_RDWR|O_CREAT|O_TRUNC, 0666);
   if(fsfd < 0){
-    perror(argv[1]);
+    perror(argv[argi]);
     exit(1);
   }
 
@@ -117,17 +130,14 @@ main(int argc, char *argv[])
   rootino = ialloc(T_DIR);
   assert(rootino == ROOTINO);
 
-  bzero(&de, sizeof(de));
-  de.inum = xshort(rootino);
-  strcpy(de.name, ".");
-  iappend(rootino, &de, sizeof(de));
-
-  bzero(&de, sizeof(de));
-  de.inum = xshort(rootino);
-  strcpy(de.name, "..");
-  iappend(rootino, &de, sizeof(de));
+  // The root's entries are written once they are all known.
+  nrootdir = 0;
+  rootdir[nrootdir].inum = xshort(rootino);
+  strcpy(rootdir[nrootdir++].name, ".");
+  rootdir[nrootdir].inum = xshort(rootino);
+  strcpy(rootdir[nrootdir++].name, "..");
 
-  for(i = 2; i < argc; i++){
+  for(i = argi+1; i < argc; i++){
     assert(index(argv[i], '/') == 0);
 
     if((fd = open(argv[i], 0)) < 0){
@@ -144,10 +154,8 @@ main(int argc, char *argv[])
 
     inum = ialloc(T_FILE);
 
-    bzero(&de, sizeof(de));
-    de.inum = xshort(inum);
-    strncpy(de.name, argv[i], DIRSIZ);
-    iappend(rootino, &de, sizeof(de));
+    rootdir[nrootdir].inum = xshort(inum);
+    strncpy(rootdir[nrootdir++].name, argv[i], DIRSIZ);
 
     while((cc = read(fd, buf, sizeof(buf))) > 0)
       iappend(inum, buf, cc);
@@ -155,12 +163,7 @@ main(int argc, char *argv[])
     close(fd);
   }
 
-  // fix size of root inode dir
-  rinode(rootino, &din);
-  off = xint(din.size);
-  off = ((off/BSIZE) + 1) * BSIZE;
-  din.size = xint(off);
-  winode(rootino, &din);
+  wdir(rootino, rootdir, nrootdir);
 
   balloc(freeblock);
 
@@ -252,6 +255,45 @@ balloc(int used)
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
+// Return the disk block of file block fbn, allocating it at
+// freeblock when fbn is the first block past the end.  Files
+// are written one at a time, so most map with one extent.
+uint
+fmap(struct dinode *din, uint fbn)
+{
+  struct extent ext[NEXTENT+NIEXTENT];
+  uint off, x;
+  int i;
+
+  memset(ext, 0, sizeof(ext));
+  memmove(ext, din->ext, sizeof(din->ext));
+  if(xint(din->extblock))
+    rsect(xint(din->extblock), (char*)&ext[NEXTENT]);
+
+  off = 0;
+  for(i = 0; i < NEXTENT+NIEXTENT && ext[i].len; i++){
+    if(fbn < off + xint(ext[i].len))
+      return xint(ext[i].start) + fbn - off;
+    off += xint(ext[i].len);
+  }
+  assert(fbn == off);
+  if(i > 0 && xint(ext[i-1].start) + xint(ext[i-1].len) == freeblock){
+    i--;
+    ext[i].len = xint(xint(ext[i].len) + 1);
+  } else {
+    assert(i < NEXTENT+NIEXTENT);
+    if(i >= NEXTENT && xint(din->extblock) == 0)
+      din->extblock = xint(freeblock++);
+    ext[i].start = xint(freeblock);
+    ext[i].len = xint(1);
+  }
+  x = freeblock++;
+  memmove(din->ext, ext, sizeof(din->ext));
+  if(i >= NEXTENT)
+    wsect(xint(din->extblock), (char*)&ext[NEXTENT]);
+  return x;
+}
+
 void
 iappend(uint inum, void *xp, int n)
 {
@@ -259,7 +301,6 @@ iappend(uint inum, void *xp, int n)
   uint fbn, off, n1;
   struct dinode din;
   char buf[BSIZE];
-  uint indirect[NINDIRECT];
   uint x;
 
   rinode(inum, &din);
@@ -268,22 +309,7 @@ iappend(uint inum, void *xp, int n)
   while(n > 0){
     fbn = off / BSIZE;
     assert(fbn < MAXFILE);
-    if(fbn < NDIRECT){
-      if(xint(din.addrs[fbn]) == 0){
-        din.addrs[fbn] = xint(freeblock++);
-      }
-      x = xint(din.addrs[fbn]);
-    } else {
-      if(xint(din.addrs[NDIRECT]) == 0){
-        din.addrs[NDIRECT] = xint(freeblock++);
-      }
-      rsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      if(indirect[fbn - NDIRECT] == 0){
-        indirect[fbn - NDIRECT] = xint(freeblock++);
-        wsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      }
-      x = xint(indirect[fbn-NDIRECT]);
-    }
+    x = fmap(&din, fbn);
     n1 = min(n, (fbn + 1) * BSIZE - off);
     rsect(x, buf);
     bcopy(p, buf + off - (fbn * BSIZE), n1);
@@ -295,3 +321,91 @@ iappend(uint inum, void *xp, int n)
   din.size = xint(off);
   winode(inum, &din);
 }
+
+// Must match dirhash() in fs.c.
+uint
+dirhash(char *name)
+{
+  uint h;
+  int i;
+
+  h = 2166136261;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = (h ^ (uchar)name[i]) * 16777619;
+  return h;
+}
+
+// Write the n dirents at de as directory inum: a plain array
+// if they fit in one block, else a hashed directory built the
+// way the kernel's dirsplit() would build it.
+void
+wdir(uint inum, struct dirent *de, int n)
+{
+  static char blk[1 + (1 << DIRDEPTH)][BSIZE];
+  struct dirhdr *th, *lh, *nh;
+  struct dirtab *tab;
+  struct dirent *e, *ne;
+  struct dinode din;
+  uint h, d, i, leaf, nblk, off;
+  int k;
+
+  if(n * sizeof(*de) <= BSIZE){
+    iappend(inum, de, n * sizeof(*de));
+
+    // fix size of directory
+    rinode(inum, &din);
+    off = xint(din.size);
+    off = ((off/BSIZE) + 1) * BSIZE;
+    din.size = xint(off);
+    winode(inum, &din);
+    return;
+  }
+
+  // A table whose one slot names an empty leaf at block 1.
+  memset(blk, 0, sizeof(blk));
+  th = (struct dirhdr*)blk[0];
+  th->magic = xshort(DIRMAGIC);
+  tab = (struct dirtab*)(th + 1);
+  DTAB(tab, 0) = xshort(1);
+  ((struct dirhdr*)blk[1])->magic = xshort(DIRMAGIC);
+  nblk = 2;
+
+  for(k = 0; k < n; k++){
+    h = dirhash(de[k].name);
+    for(;;){
+      leaf = xshort(DTAB(tab, h & ((1 << xshort(th->depth)) - 1)));
+      lh = (struct dirhdr*)blk[leaf];
+      for(e = (struct dirent*)(lh + 1); e < (struct dirent*)blk[leaf+1]; e++)
+        if(e->inum == 0)
+          break;
+      if(e < (struct dirent*)blk[leaf+1]){
+        *e = de[k];
+        break;
+      }
+
+      // Split the full leaf by hash bit d.
+      d = xshort(lh->depth);
+      if(d == xshort(th->depth)){
+        assert(d < DIRDEPTH);
+        for(i = 0; i < (1 << d); i++)
+          DTAB(tab, i + (1 << d)) = DTAB(tab, i);
+        th->depth = xshort(d + 1);
+      }
+      nh = (struct dirhdr*)blk[nblk];
+      nh->magic = xshort(DIRMAGIC);
+      nh->depth = lh->depth = xshort(d + 1);
+      ne = (struct dirent*)(nh + 1);
+      for(e = (struct dirent*)(lh + 1); e < (struct dirent*)blk[leaf+1]; e++){
+        if(e->inum != 0 && (dirhash(e->name) >> d) & 1){
+          *ne++ = *e;
+          bzero(e, sizeof(*e));
+        }
+      }
+      for(i = 0; i < (1 << xshort(th->depth)); i++)
+        if(xshort(DTAB(tab, i)) == leaf && (i >> d) & 1)
+          DTAB(tab, i) = xshort(nblk);
+      nblk++;
+    }
+  }
+  iappend(inum, blk, nblk * BSIZE);
+}
@@ -3,12 +3,29 @@
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NINODE       50  // i-nodes cached to start with
+#define NINODEPAGE   16  // max kalloc pages the i-node cache may grow into
+#define NDCACHE     128  // directory name cache entries
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define DIROPBLOCKS  16  // max # of blocks an FS op that adds a name writes
+#define LOGSIZE      (MAXOPBLOCKS*6)  // default blocks in on-disk log (mkfs -l)
+#define LOGMAX       120  // max data blocks the kernel uses in the log
+#define NBUF         (LOGMAX*2+MAXIOBLOCKS+RAMAX)  // minimum size of disk block cache
+#define MAXIOBLOCKS   8  // max # of blocks in one disk command
+#define RAMAX        32  // max blocks read ahead of a sequential reader
+#define IODEADLINE   10  // ticks a disk request waits before it jumps the elevator
+#define NBUFPAGE    256  // max kalloc pages the block cache may grow into
+#define NPCACHE     256  // pages of program files cached for demand paging
+#define NSEG          4  // program segments exec() demand pages
+#define PREALLOC      8  // free blocks held ahead of a file that is growing
+#ifndef FSSIZE
+#define FSSIZE      20000  // size of file system in blocks (make FSSIZE=n)
+#endif
+#define MAXBMAPBLOCKS (MAXOPBLOCKS-3)  // max free-map blocks: itrunc in unlink may write them all
+#define NMLFQ         3  // number of scheduler priority levels
+#define BOOSTTICKS  100  // ticks between MLFQ priority boosts
+#define MLFQQUANTA  { 1, 4, 16 }  // ticks run at each level before moving down
 
@@ -0,0 +1,196 @@
+// Page cache: whole pages of file contents.
+//
+// A page is named by its inode and the page-aligned file
+// offset it starts at.  readi() copies a file's data out
+// of its pages, and writei() copies new data into any that
+// are cached as well as into the logged blocks, so a
+// cached page always matches the file.  The pages can be
+// mapped into user memory directly: processes running the
+// same program map the same pages, read-only for text and
+// copy-on-write for data.  writei() refuses to change a
+// file while it is being run, and pcwrite() leaves any
+// page still mapped alone, taking it out of the cache.
+//
+// Each page holds one kalloc() reference for the cache,
+// and one for each mapping or reader using it; a page only
+// the cache refers to may be reused, and is given back to
+// kalloc() when memory runs low.
+//
+// Pages are filled, written and dropped with the inode
+// locked, so no one waits for a page to be read in.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+
+#define NPHASH 61
+
+struct page {
+  uint dev;
+  uint inum;          // 0 if the entry is empty
+  uint off;           // file offset of data[0]
+  char *data;
+  struct page *next;  // hash chain
+};
+
+struct {
+  struct spinlock lock;
+  struct page page[NPCACHE];
+  struct page *hash[NPHASH];
+  int hand;           // next entry to consider reusing
+} pcache;
+
+void
+pcinit(void)
+{
+  initlock(&pcache.lock, "pcache");
+}
+
+static struct page**
+phash(uint dev, uint inum, uint off)
+{
+  return &pcache.hash[(dev*31 + inum*17 + off/PGSIZE) % NPHASH];
+}
+
+// Remove pg from the cache, giving up the cache's
+// reference to its data.  Caller must hold pcache.lock.
+static void
+pcremove(struct page *pg)
+{
+  struct page **pp;
+
+  for(pp = phash(pg->dev, pg->inum, pg->off); *pp != pg; pp = &(*pp)->next)
+    ;
+  *pp = pg->next;
+  kfree(pg->data);
+  pg->inum = 0;
+  pg->data = 0;
+}
+
+// Find an entry to reuse: an empty one, or a page no
+// process maps.  Caller must hold pcache.lock.
+static struct page*
+pcvictim(void)
+{
+  struct page *pg;
+  int i;
+
+  for(i = 0; i < NPCACHE; i++){
+    pg = &pcache.page[pcache.hand];
+    pcache.hand = (pcache.hand + 1) % NPCACHE;
+    if(pg->inum == 0)
+      return pg;
+    if(krefcount(pg->data) == 1){
+      pcremove(pg);
+      return pg;
+    }
+  }
+  return 0;
+}
+
+// Return the page of ip's contents at off, which must be
+// page aligned, with a kalloc() reference for the caller.
+// Bytes past the end of the file are zero.  The page may
+// be shared: the caller must not write it.  Returns 0 if
+// out of memory.  Caller must hold ip->lock.
+char*
+pcget(struct inode *ip, uint off)
+{
+  struct page *pg, **pp;
+  char *data;
+
+  acquire(&pcache.lock);
+  for(pg = *phash(ip->dev, ip->inum, off); pg; pg = pg->next){
+    if(pg->dev == ip->dev && pg->inum == ip->inum && pg->off == off){
+      kref(pg->data);
+      release(&pcache.lock);
+      return pg->data;
+    }
+  }
+  release(&pcache.lock);
+
+  if((data = kalloc()) == 0)
+    return 0;
+  memset(data, 0, PGSIZE);
+  if(off < ip->size)
+    readbufs(ip, data, off, PGSIZE);
+
+  // Keep it if an entry is free; else the caller
+  // has a private copy.
+  acquire(&pcache.lock);
+  if((pg = pcvictim()) != 0){
+    pg->dev = ip->dev;
+    pg->inum = ip->inum;
+    pg->off = off;
+    pg->data = data;
+    pp = phash(pg->dev, pg->inum, off);
+    pg->next = *pp;
+    *pp = pg;
+    kref(data);
+  }
+  release(&pcache.lock);
+  return data;
+}
+
+// Copy n bytes from src into the cached page of ip that
+// holds offset off, if there is one.  The bytes must lie
+// within one page.  A page someone else still refers to
+// is dropped instead, so they keep the old contents.
+// Caller must hold ip->lock.
+void
+pcwrite(struct inode *ip, uint off, char *src, uint n)
+{
+  struct page *pg;
+
+  acquire(&pcache.lock);
+  for(pg = *phash(ip->dev, ip->inum, PGROUNDDOWN(off)); pg; pg = pg->next){
+    if(pg->dev == ip->dev && pg->inum == ip->inum && pg->off == PGROUNDDOWN(off)){
+      if(krefcount(pg->data) > 1)
+        pcremove(pg);
+      else
+        memmove(pg->data + off%PGSIZE, src, n);
+      break;
+    }
+  }
+  release(&pcache.lock);
+}
+
+// Forget ip's pages, as its contents are going away.
+// Processes already mapping them keep them.
+// Caller must hold ip->lock.
+void
+pcdrop(struct inode *ip)
+{
+  struct page *pg;
+
+  acquire(&pcache.lock);
+  for(pg = pcache.page; pg < &pcache.page[NPCACHE]; pg++)
+    if(pg->inum == ip->inum && pg->dev == ip->dev)
+      pcremove(pg);
+  release(&pcache.lock);
+}
+
+// Give back pages no process maps.  Called by
+// kalloc() when free memory runs low.
+int
+pcreclaim(void)
+{
+  struct page *pg;
+  int n;
+
+  n = 0;
+  acquire(&pcache.lock);
+  for(pg = pcache.page; pg < &pcache.page[NPCACHE]; pg++){
+    if(pg->inum != 0 && krefcount(pg->data) == 1){
+      pcremove(pg);
+      n++;
+    }
+  }
+  release(&pcache.lock);
+  return n;
+}
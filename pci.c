@@ -0,0 +1,71 @@
+// Minimal PCI support: find a function on bus 0 and reach
+// its configuration registers, for the disk drivers.
+
+#include "types.h"
+#include "defs.h"
+#include "x86.h"
+#include "pci.h"
+
+static uint
+confaddr(struct pcidev *d, int off)
+{
+  return 0x80000000 | (d->bus << 16) | (d->dev << 11) |
+         (d->func << 8) | (off & 0xfc);
+}
+
+uint
+pciread(struct pcidev *d, int off)
+{
+  outl(PCI_CONFADDR, confaddr(d, off));
+  return inl(PCI_CONFDATA);
+}
+
+void
+pciwrite(struct pcidev *d, int off, uint v)
+{
+  outl(PCI_CONFADDR, confaddr(d, off));
+  outl(PCI_CONFDATA, v);
+}
+
+// Find the first function matching vendor, device, class
+// and subclass; -1 matches anything.  Fills in *d and
+// returns 0, or returns -1 if there is none.
+int
+pcifind(struct pcidev *d, int vendor, int device, int class, int subclass)
+{
+  uint id, cl;
+
+  d->bus = 0;
+  for(d->dev = 0; d->dev < 32; d->dev++){
+    for(d->func = 0; d->func < 8; d->func++){
+      id = pciread(d, PCI_ID);
+      if((id & 0xffff) == 0xffff)
+        continue;
+      cl = pciread(d, PCI_CLASS);
+      d->vendor = id & 0xffff;
+      d->device = id >> 16;
+      d->class = cl >> 24;
+      d->subclass = (cl >> 16) & 0xff;
+      d->progif = (cl >> 8) & 0xff;
+      if((vendor < 0 || vendor == d->vendor) &&
+         (device < 0 || device == d->device) &&
+         (class < 0 || class == d->class) &&
+         (subclass < 0 || subclass == d->subclass))
+        return 0;
+    }
+  }
+  return -1;
+}
+
+// Return the I/O port base of an I/O space BAR, or 0 if
+// bar n maps memory or nothing.
+uint
+pciiobar(struct pcidev *d, int n)
+{
+  uint bar;
+
+  bar = pciread(d, PCI_BAR0 + 4*n);
+  if((bar & 1) == 0)
+    return 0;
+  return bar & ~3;
+}
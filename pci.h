@@ -0,0 +1,22 @@
+// PCI configuration space, reached through the
+// configuration mechanism #1 I/O ports.
+
+#define PCI_CONFADDR  0xcf8
+#define PCI_CONFDATA  0xcfc
+
+// Configuration header registers (byte offsets).
+#define PCI_ID        0x00   // device << 16 | vendor
+#define PCI_CMD       0x04   // command (low 16 bits)
+  #define PCI_CMD_IO     0x1   // respond to I/O space
+  #define PCI_CMD_MEM    0x2   // respond to memory space
+  #define PCI_CMD_MASTER 0x4   // bus master
+#define PCI_CLASS     0x08   // class << 24 | subclass << 16 | progif << 8 | rev
+#define PCI_BAR0      0x10   // base address registers, 4 bytes each
+#define PCI_INTR      0x3c   // interrupt line (low byte)
+
+// A function found on bus 0.
+struct pcidev {
+  int bus, dev, func;
+  ushort vendor, device;
+  uchar class, subclass, progif;
+};
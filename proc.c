@@ -6,12 +6,38 @@
 #include "x86.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "traps.h"
 
 struct {
   struct spinlock lock;
   struct proc proc[NPROC];
 } ptable;
 
+// Per-CPU run queues.  Each CPU chooses its next process from
+// its own RUNNABLE processes, so picking is O(1) and an idle
+// CPU spins on its own queue lock instead of ptable.lock.
+// A RUNNABLE process is on exactly one queue, linked through
+// p->rqnext.  Lock order: ptable.lock, then runq[i].lock.
+//
+// Each queue is a multi-level feedback queue: one FIFO per
+// priority level, highest (0) served first.  A process that
+// uses up its level's quantum drops a level, so CPU-bound work
+// sinks and gets longer slices while processes that mostly
+// sleep (the shell waiting on the console) stay on top.
+// Every BOOSTTICKS ticks mlfqboost() lifts everything back to
+// level 0 so nothing starves.
+struct runq {
+  struct spinlock lock;
+  struct proc *head[NMLFQ];
+  struct proc *tail[NMLFQ];
+  int len;
+};
+static struct runq runq[NCPU];
+
+// Timer ticks a process may run at each level before it
+// is preempted and moved down, one per level.
+static int mlfqquantum[NMLFQ] = MLFQQUANTA;
+
 static struct proc *initproc;
 
 int nextpid = 1;
@@ -24,7 +50,158 @@ static void wakeup1(void *chan);
 void
 pinit(void)
 {
+  int i;
+
   initlock(&ptable.lock, "ptable");
+  for(i = 0; i < NCPU; i++)
+    initlock(&runq[i].lock, "runq");
+}
+
+// Append p to the tail of its level's list in cpu's
+// run queue.  Returns the new queue length.
+static int
+runqappend(int cpu, struct proc *p)
+{
+  int n, l;
+  struct runq *rq = &runq[cpu];
+
+  l = p->level;
+  acquire(&rq->lock);
+  p->rqnext = 0;
+  if(rq->tail[l])
+    rq->tail[l]->rqnext = p;
+  else
+    rq->head[l] = p;
+  rq->tail[l] = p;
+  n = ++rq->len;
+  release(&rq->lock);
+  return n;
+}
+
+// Remove and return the first process of the highest
+// non-empty level of cpu's run queue, or 0 if the queue
+// is empty.
+static struct proc*
+runqpop(int cpu)
+{
+  struct runq *rq = &runq[cpu];
+  struct proc *p;
+  int l;
+
+  p = 0;
+  acquire(&rq->lock);
+  for(l = 0; l < NMLFQ; l++){
+    if((p = rq->head[l]) != 0){
+      rq->head[l] = p->rqnext;
+      if(rq->head[l] == 0)
+        rq->tail[l] = 0;
+      p->rqnext = 0;
+      rq->len--;
+      break;
+    }
+  }
+  release(&rq->lock);
+  return p;
+}
+
+// Called by an idle CPU: take a process from the CPU
+// with the longest run queue.  Returns 0 if no other
+// CPU has anything waiting.
+static struct proc*
+runqsteal(int self)
+{
+  int i, victim;
+
+  victim = -1;
+  for(i = 0; i < ncpu; i++){
+    if(i == self || runq[i].len == 0)
+      continue;
+    if(victim < 0 || runq[i].len > runq[victim].len)
+      victim = i;
+  }
+  if(victim < 0)
+    return 0;
+  return runqpop(victim);
+}
+
+// Load of a CPU for placement: waiting processes plus
+// the one it is running, if any.
+static int
+cpuload(int cpu)
+{
+  return runq[cpu].len + (cpus[cpu].proc != 0);
+}
+
+// Choose a CPU for a new process: the least loaded one.
+// The loads are read without locks; a stale answer only
+// costs some balance, which stealing will repair.
+static int
+runqpick(void)
+{
+  int i, best;
+
+  best = 0;
+  for(i = 1; i < ncpu; i++)
+    if(cpuload(i) < cpuload(best))
+      best = i;
+  return best;
+}
+
+// Mark p RUNNABLE and put it on the run queue of
+// the CPU it last ran on.  If that CPU is halted, wake
+// it; if p has to wait there, behind others or behind
+// another running process, wake some halted CPU to
+// steal it.  A process that yields waits for no one.
+// Caller must hold ptable.lock.
+static void
+setrunnable(struct proc *p)
+{
+  int i, n;
+  struct proc *running;
+
+  if(!holding(&ptable.lock))
+    panic("setrunnable");
+  p->state = RUNNABLE;
+  n = runqappend(p->cpu, p);
+  if(cpus[p->cpu].idle){
+    lapicipi(cpus[p->cpu].apicid, T_IRQ0 + IRQ_RESCHED);
+    return;
+  }
+  running = cpus[p->cpu].proc;
+  if(n > 1 || (running != 0 && running != p)){
+    for(i = 0; i < ncpu; i++){
+      if(cpus[i].idle){
+        lapicipi(cpus[i].apicid, T_IRQ0 + IRQ_RESCHED);
+        break;
+      }
+    }
+  }
+}
+
+// Nothing to run anywhere: halt this CPU until an
+// interrupt arrives.  The CPU is marked idle before it
+// looks at the queues one last time, under their locks,
+// so a process queued after a look is queued by a
+// setrunnable() that sees the mark.  Interrupts stay off
+// from then until the hlt, so its wakeup IPI cannot be
+// lost.
+static void
+runqidle(struct cpu *c)
+{
+  int i;
+
+  cli();
+  c->idle = 1;
+  for(i = 0; i < ncpu && c->idle; i++){
+    acquire(&runq[i].lock);
+    if(runq[i].len > 0)
+      c->idle = 0;
+    release(&runq[i].lock);
+  }
+  if(c->idle){
+    stihlt();
+    c->idle = 0;
+  }
 }
 
 // Must be called with interrupts disabled
@@ -89,6 +266,8 @@ allocproc(void)
 found:
   p->state = EMBRYO;
   p->pid = nextpid++;
+  p->level = 0;
+  p->tickused = 0;
 
   release(&ptable.lock);
 
@@ -149,11 +328,59 @@ userinit(void)
   // because the assignment might not be atomic.
   acquire(&ptable.lock);
 
-  p->state = RUNNABLE;
+  p->cpu = 0;
+  setrunnable(p);
+
+  release(&ptable.lock);
+}
+
+// Start a kernel process that runs fn, which must never
+// return.  It has no user memory and its parent is init.
+void
+kproc(char *name, void (*fn)(void))
+{
+  struct proc *p;
+
+  if((p = allocproc()) == 0)
+    panic("kproc");
+  if((p->pgdir = setupkvm()) == 0)
+    panic("kproc: out of memory");
+  // forkret() returns into fn instead of trapret.
+  *(uint*)((char*)p->tf - 4) = (uint)fn;
+  p->parent = initproc;
+  safestrcpy(p->name, name, sizeof(p->name));
+
+  acquire(&ptable.lock);
+
+  p->cpu = runqpick();
+  setrunnable(p);
 
   release(&ptable.lock);
 }
 
+// Forget the parts of p's demand-paged segments at or
+// above sz, so memory grown there again starts out zero
+// rather than paged in from the program file.
+static void
+segclip(struct proc *p, uint sz)
+{
+  struct seg *s;
+  int i;
+
+  for(i = 0; i < p->nseg; ){
+    s = &p->seg[i];
+    if(s->va >= sz){
+      *s = p->seg[--p->nseg];
+      continue;
+    }
+    if(s->end > sz)
+      s->end = sz;
+    if(s->fend > sz)
+      s->fend = sz;
+    i++;
+  }
+}
+
 // Grow current process's memory by n bytes.
 // Return 0 on success, -1 on failure.
 int
@@ -164,11 +391,16 @@ growproc(int n)
 
   sz = curproc->sz;
   if(n > 0){
-    if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    // Only reserve the address space: pgfault() allocates
+    // each page when it is first touched.  Refuse to reserve
+    // more than free memory could back.
+    if(sz + n >= KERNBASE || PGROUNDUP(n)/PGSIZE > kfreepages())
       return -1;
+    sz += n;
   } else if(n < 0){
     if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
       return -1;
+    segclip(curproc, sz);
   }
   curproc->sz = sz;
   switchuvm(curproc);
@@ -198,6 +430,13 @@ fork(void)
     return -1;
   }
   np->sz = curproc->sz;
+  np->exe = 0;
+  if(curproc->exe){
+    np->exe = idup(curproc->exe);
+    itext(np->exe, 1);
+  }
+  np->nseg = curproc->nseg;
+  memmove(np->seg, curproc->seg, sizeof(np->seg));
   np->parent = curproc;
   *np->tf = *curproc->tf;
 
@@ -215,7 +454,67 @@ fork(void)
 
   acquire(&ptable.lock);
 
-  np->state = RUNNABLE;
+  np->cpu = runqpick();
+  setrunnable(np);
+
+  release(&ptable.lock);
+
+  return pid;
+}
+
+// Create a new process running the program in path with
+// argv, straight from the file rather than from a copy of
+// the caller.  Its descriptor i refers to f[i] for i < 3,
+// and it has no others; its cwd is the caller's.
+// Returns the new pid, or -1 on failure.
+int
+spawn(char *path, char **argv, struct file **f)
+{
+  int i, pid;
+  struct image im;
+  struct proc *np;
+  struct proc *curproc = myproc();
+
+  if(loadimage(path, argv, &im) < 0)
+    return -1;
+  if((np = allocproc()) == 0){
+    freevm(im.pgdir);
+    if(im.exe){
+      itext(im.exe, -1);
+      begin_op();
+      iput(im.exe);
+      end_op();
+    }
+    return -1;
+  }
+  np->pgdir = im.pgdir;
+  np->sz = im.sz;
+  np->exe = im.exe;
+  np->nseg = im.nseg;
+  memmove(np->seg, im.seg, sizeof(im.seg));
+  np->parent = curproc;
+  memset(np->tf, 0, sizeof(*np->tf));
+  np->tf->cs = (SEG_UCODE << 3) | DPL_USER;
+  np->tf->ds = (SEG_UDATA << 3) | DPL_USER;
+  np->tf->es = np->tf->ds;
+  np->tf->ss = np->tf->ds;
+  np->tf->eflags = FL_IF;
+  np->tf->esp = im.sp;
+  np->tf->eip = im.entry;
+
+  for(i = 0; i < 3; i++)
+    if(f[i])
+      np->ofile[i] = filedup(f[i]);
+  np->cwd = idup(curproc->cwd);
+
+  safestrcpy(np->name, im.name, sizeof(np->name));
+
+  pid = np->pid;
+
+  acquire(&ptable.lock);
+
+  np->cpu = runqpick();
+  setrunnable(np);
 
   release(&ptable.lock);
 
@@ -245,8 +544,13 @@ exit(void)
 
   begin_op();
   iput(curproc->cwd);
+  if(curproc->exe){
+    itext(curproc->exe, -1);
+    iput(curproc->exe);
+  }
   end_op();
   curproc->cwd = 0;
+  curproc->exe = 0;
 
   acquire(&ptable.lock);
 
@@ -325,34 +629,41 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int id = c - cpus;
   c->proc = 0;
   
   for(;;){
     // Enable interrupts on this processor.
     sti();
 
-    // Loop over process table looking for process to run.
-    acquire(&ptable.lock);
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->state != RUNNABLE)
-        continue;
-
-      // Switch to chosen process.  It is the process's job
-      // to release ptable.lock and then reacquire it
-      // before jumping back to us.
-      c->proc = p;
-      switchuvm(p);
-      p->state = RUNNING;
-
-      swtch(&(c->scheduler), p->context);
-      switchkvm();
-
-      // Process is done running for now.
-      // It should have changed its p->state before coming back.
-      c->proc = 0;
+    // Take the next process off this CPU's run queue, or
+    // steal one from the busiest CPU.  Only queue locks are
+    // needed to choose; ptable.lock is taken just for the
+    // switch itself.
+    if((p = runqpop(id)) == 0 && (p = runqsteal(id)) == 0){
+      runqidle(c);
+      continue;
     }
-    release(&ptable.lock);
 
+    acquire(&ptable.lock);
+    if(p->state != RUNNABLE)
+      panic("scheduler: queued proc not runnable");
+
+    // Switch to chosen process.  It is the process's job
+    // to release ptable.lock and then reacquire it
+    // before jumping back to us.
+    c->proc = p;
+    p->cpu = id;
+    switchuvm(p);
+    p->state = RUNNING;
+
+    swtch(&(c->scheduler), p->context);
+    switchkvm();
+
+    // Process is done running for now.
+    // It should have changed its p->state before coming back.
+    c->proc = 0;
+    release(&ptable.lock);
   }
 }
 
@@ -382,12 +693,67 @@ sched(void)
   mycpu()->intena = intena;
 }
 
+// Charge the current process for one timer tick.
+// Returns 1 if it should give up the CPU: either it has
+// used its quantum at this level (and drops a level), or
+// a higher-priority process is waiting on this CPU.
+int
+schedtick(void)
+{
+  struct proc *p = myproc();
+  int l;
+
+  if(++p->tickused >= mlfqquantum[p->level]){
+    p->tickused = 0;
+    if(p->level < NMLFQ-1)
+      p->level++;
+    return 1;
+  }
+  for(l = 0; l < p->level; l++)
+    if(runq[p->cpu].head[l])
+      return 1;
+  return 0;
+}
+
+// Priority boost: move every process back to level 0 so
+// CPU-bound processes at the bottom cannot be starved by
+// a stream of interactive ones.  Called from the timer
+// interrupt every BOOSTTICKS ticks.
+void
+mlfqboost(void)
+{
+  struct proc *p;
+  struct runq *rq;
+  int l;
+
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    p->level = 0;
+    p->tickused = 0;
+  }
+  for(rq = runq; rq < &runq[ncpu]; rq++){
+    acquire(&rq->lock);
+    for(l = 1; l < NMLFQ; l++){
+      if(rq->head[l] == 0)
+        continue;
+      if(rq->tail[0])
+        rq->tail[0]->rqnext = rq->head[l];
+      else
+        rq->head[0] = rq->head[l];
+      rq->tail[0] = rq->tail[l];
+      rq->head[l] = rq->tail[l] = 0;
+    }
+    release(&rq->lock);
+  }
+  release(&ptable.lock);
+}
+
 // Give up the CPU for one scheduling round.
 void
 yield(void)
 {
   acquire(&ptable.lock);  //DOC: yieldlock
-  myproc()->state = RUNNABLE;
+  setrunnable(myproc());
   sched();
   release(&ptable.lock);
 }
@@ -405,9 +771,10 @@ forkret(void)
     // Some initialization functions must be run in the context
     // of a regular process (e.g., they call sleep), and thus cannot
     // be run from main().
+    // Recover the log before iinit() reads the bitmap.
     first = 0;
-    iinit(ROOTDEV);
     initlog(ROOTDEV);
+    iinit(ROOTDEV);
   }
 
   // Return to "caller", actually trapret (see allocproc).
@@ -462,7 +829,7 @@ wakeup1(void *chan)
 
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
     if(p->state == SLEEPING && p->chan == chan)
-      p->state = RUNNABLE;
+      setrunnable(p);
 }
 
 // Wake up all processes sleeping on chan.
@@ -488,7 +855,51 @@ kill(int pid)
       p->killed = 1;
       // Wake process from sleep if necessary.
       if(p->state == SLEEPING)
-        p->state = RUNNABLE;
+        setrunnable(p);
+      release(&ptable.lock);
+      return 0;
+    }
+  }
+  release(&ptable.lock);
+  return -1;
+}
+
+// Return the MLFQ level of process pid, or -1 if
+// there is no such process.
+int
+getlevel(int pid)
+{
+  struct proc *p;
+  int level;
+
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->pid == pid && p->state != UNUSED){
+      level = p->level;
+      release(&ptable.lock);
+      return level;
+    }
+  }
+  release(&ptable.lock);
+  return -1;
+}
+
+// Set the MLFQ level of process pid and give it a fresh
+// quantum there.  A process already waiting in a run queue
+// keeps its place until it is next queued.
+// Returns -1 if there is no such process or bad level.
+int
+setlevel(int pid, int level)
+{
+  struct proc *p;
+
+  if(level < 0 || level >= NMLFQ)
+    return -1;
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->pid == pid && p->state != UNUSED){
+      p->level = level;
+      p->tickused = 0;
       release(&ptable.lock);
       return 0;
     }
@@ -524,7 +935,7 @@ procdump(void)
       state = states[p->state];
     else
       state = "???";
-    cprintf("%d %s %s", p->pid, state, p->name);
+    cprintf("%d %s %s L%d", p->pid, state, p->name, p->level);
     if(p->state == SLEEPING){
       getcallerpcs((uint*)p->context->ebp+2, pc);
       for(i=0; i<10 && pc[i] != 0; i++)
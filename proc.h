@@ -8,6 +8,7 @@ struct cpu {
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
+  volatile uint idle;          // Halted in scheduler() waiting for work?
 };
 
 extern struct cpu cpus[NCPU];
@@ -34,6 +35,31 @@ struct context {
 
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+// A program segment that page faults read in from the
+// file: addresses va..end-1, of which va..fend-1 hold file
+// contents starting at offset off.  va and off are page
+// aligned; the rest of the segment is zero.
+struct seg {
+  uint va;
+  uint fend;
+  uint end;
+  uint off;
+  int writable;
+};
+
+// A new user memory image, built by loadimage() for
+// exec() and spawn().
+struct image {
+  pde_t *pgdir;
+  uint sz;
+  uint entry;                  // initial eip
+  uint sp;                     // initial esp
+  char *name;                  // program name, within the path
+  struct inode *exe;           // as for struct proc
+  int nseg;
+  struct seg seg[NSEG];
+};
+
 // Per-process state
 struct proc {
   uint sz;                     // Size of process memory (bytes)
@@ -49,6 +75,13 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  int cpu;                     // CPU whose run queue holds or last ran this proc
+  struct proc *rqnext;         // Next proc on that CPU's run queue
+  int level;                   // MLFQ priority level, 0 is highest
+  int tickused;                // Ticks used of the quantum at this level
+  struct inode *exe;           // Program file, if any segments are in seg
+  int nseg;
+  struct seg seg[NSEG];        // Segments paged in from exe on demand
 };
 
 // Process memory is laid out contiguously, low addresses first:
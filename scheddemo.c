@@ -1,6 +1,9 @@
 // scheddemo.c - Round Robin Scheduling Demo for xv6
 // Usage: scheddemo [nprocs]
+//        scheddemo -l [rounds]
 // Demonstrates process scheduling with timing metrics
+//   -l: Measure context switch latency with 1..ncpu
+//       concurrent ping-pong pairs
 
 #include "types.h"
 #include "stat.h"
@@ -9,6 +12,7 @@
 
 #define MAX_PROCS 6
 #define TIME_QUANTUM 10
+#define LAT_ROUNDS 2000
 
 struct procstat {
   int pid;
@@ -27,12 +31,99 @@ dowork(int ticks)
     x++;
 }
 
+// Bounce one byte between a parent/child pair over two
+// pipes.  Every round trip blocks each side once, so it
+// costs two sleep/wakeup context switches.
+void
+pingpong(int rounds)
+{
+  int p1[2], p2[2], i, pid;
+  char c = 0;
+
+  if(pipe(p1) < 0 || pipe(p2) < 0) {
+    printf(1, "pipe failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0) {
+    printf(1, "fork failed\n");
+    exit();
+  }
+  if(pid == 0) {
+    for(i = 0; i < rounds; i++) {
+      read(p1[0], &c, 1);
+      write(p2[1], &c, 1);
+    }
+    exit();
+  }
+  for(i = 0; i < rounds; i++) {
+    write(p1[1], &c, 1);
+    read(p2[0], &c, 1);
+  }
+  wait();
+  close(p1[0]); close(p1[1]);
+  close(p2[0]); close(p2[1]);
+}
+
+// Run 1..ncpu ping-pong pairs at once and report how long
+// the switches take.  With per-CPU run queues the time per
+// switch should stay flat as pairs are added, instead of
+// growing with contention on one scheduler lock.
+void
+latency(int rounds)
+{
+  struct sysinfo info;
+  int npairs, i, t0, t;
+  uint nswitch;
+
+  if(getsysinfo(&info) < 0) {
+    printf(1, "getsysinfo failed\n");
+    exit();
+  }
+
+  printf(1, "\n");
+  printf(1, "================================================\n");
+  printf(1, "      XV6 Context Switch Latency\n");
+  printf(1, "================================================\n\n");
+  printf(1, "CPUs: %d  Round trips per pair: %d\n\n", info.ncpu, rounds);
+  printf(1, "Pairs  Ticks  Switches  Switches/tick  us/switch\n");
+  printf(1, "-----  -----  --------  -------------  ---------\n");
+
+  for(npairs = 1; npairs <= info.ncpu; npairs++) {
+    t0 = uptime();
+    for(i = 0; i < npairs; i++) {
+      if(fork() == 0) {
+        pingpong(rounds);
+        exit();
+      }
+    }
+    for(i = 0; i < npairs; i++)
+      wait();
+    t = uptime() - t0;
+    if(t == 0)
+      t = 1;
+    nswitch = 2 * rounds * npairs;
+    // One tick is 10ms; each pair runs on its own CPU, so
+    // wall-clock time per switch is per pair.
+    printf(1, "%d      %d      %d      %d          %d\n",
+           npairs, t, nswitch, nswitch / t,
+           (t * 10000) / (2 * rounds));
+  }
+  printf(1, "================================================\n\n");
+}
+
 int
 main(int argc, char *argv[])
 {
   int i, pid, nprocs = 4;
   int burst[] = {15, 10, 20, 12, 18, 8};
   
+  if(argc > 1 && strcmp(argv[1], "-l") == 0) {
+    i = (argc > 2) ? atoi(argv[2]) : LAT_ROUNDS;
+    latency(i > 0 ? i : LAT_ROUNDS);
+    exit();
+  }
+
   if(argc > 1) {
     nprocs = atoi(argv[1]);
     if(nprocs < 2) nprocs = 2;
@@ -52,12 +52,14 @@ struct backcmd {
 int fork1(void);  // Fork but panics on failure.
 void panic(char*);
 struct cmd *parsecmd(char*);
+void freecmd(struct cmd*);
+int spawncmd(struct cmd*, int, int);
 
 // Execute cmd.  Never returns.
 void
 runcmd(struct cmd *cmd)
 {
-  int p[2];
+  int p[2], pid, n;
   struct backcmd *bcmd;
   struct execcmd *ecmd;
   struct listcmd *lcmd;
@@ -91,9 +93,10 @@ runcmd(struct cmd *cmd)
 
   case LIST:
     lcmd = (struct listcmd*)cmd;
-    if(fork1() == 0)
+    if((pid = spawncmd(lcmd->left, 0, 1)) < 0 && (pid = fork1()) == 0)
       runcmd(lcmd->left);
-    wait();
+    if(pid > 0)
+      wait();
     runcmd(lcmd->right);
     break;
 
@@ -101,35 +104,90 @@ runcmd(struct cmd *cmd)
     pcmd = (struct pipecmd*)cmd;
     if(pipe(p) < 0)
       panic("pipe");
-    if(fork1() == 0){
+    n = 0;
+    if((pid = spawncmd(pcmd->left, 0, p[1])) < 0 && (pid = fork1()) == 0){
       close(1);
       dup(p[1]);
       close(p[0]);
       close(p[1]);
       runcmd(pcmd->left);
     }
-    if(fork1() == 0){
+    if(pid > 0)
+      n++;
+    if((pid = spawncmd(pcmd->right, p[0], 1)) < 0 && (pid = fork1()) == 0){
       close(0);
       dup(p[0]);
       close(p[0]);
       close(p[1]);
       runcmd(pcmd->right);
     }
+    if(pid > 0)
+      n++;
     close(p[0]);
     close(p[1]);
-    wait();
-    wait();
+    while(n-- > 0)
+      wait();
     break;
 
   case BACK:
     bcmd = (struct backcmd*)cmd;
-    if(fork1() == 0)
+    if(spawncmd(bcmd->cmd, 0, 1) < 0 && fork1() == 0)
       runcmd(bcmd->cmd);
     break;
   }
   exit();
 }
 
+// Run cmd, if it is a program with only redirections around
+// it, in a process spawned straight from the program file,
+// with in and out as its fds 0 and 1; the shell need not
+// fork a copy of itself.  Returns the pid, 0 if nothing was
+// started, or -1 if cmd needs a shell to run it.
+int
+spawncmd(struct cmd *cmd, int in, int out)
+{
+  struct cmd *c;
+  struct execcmd *ecmd;
+  struct redircmd *rcmd;
+  int fd[3], opened[3], i, pid;
+
+  for(c = cmd; c && c->type == REDIR; c = ((struct redircmd*)c)->cmd)
+    ;
+  if(c == 0 || c->type != EXEC)
+    return -1;
+  ecmd = (struct execcmd*)c;
+
+  fd[0] = in;
+  fd[1] = out;
+  fd[2] = 2;
+  for(i = 0; i < 3; i++)
+    opened[i] = -1;
+  pid = 0;
+  // Outer redirections first, so inner ones win, as in runcmd().
+  for(c = cmd; c->type == REDIR; c = rcmd->cmd){
+    rcmd = (struct redircmd*)c;
+    if(opened[rcmd->fd] >= 0)
+      close(opened[rcmd->fd]);
+    if((opened[rcmd->fd] = open(rcmd->file, rcmd->mode)) < 0){
+      printf(2, "open %s failed\n", rcmd->file);
+      goto done;
+    }
+    fd[rcmd->fd] = opened[rcmd->fd];
+  }
+  if(ecmd->argv[0] == 0)
+    goto done;
+  if((pid = spawn(ecmd->argv[0], ecmd->argv, fd)) < 0){
+    printf(2, "exec %s failed\n", ecmd->argv[0]);
+    pid = 0;
+  }
+
+done:
+  for(i = 0; i < 3; i++)
+    if(opened[i] >= 0)
+      close(opened[i]);
+  return pid;
+}
+
 int
 getcmd(char *buf, int nbuf)
 {
@@ -145,7 +203,8 @@ int
 main(void)
 {
   static char buf[100];
-  int fd;
+  int fd, pid;
+  struct cmd *cmd;
 
   // Ensure that three file descriptors are open.
   while((fd = open("console", O_RDWR)) >= 0){
@@ -164,9 +223,13 @@ main(void)
         printf(2, "cannot cd %s\n", buf+3);
       continue;
     }
-    if(fork1() == 0)
-      runcmd(parsecmd(buf));
-    wait();
+    if((cmd = parsecmd(buf)) == 0)
+      continue;
+    if((pid = spawncmd(cmd, 0, 1)) < 0 && (pid = fork1()) == 0)
+      runcmd(cmd);
+    if(pid > 0)
+      wait();
+    freecmd(cmd);
   }
   exit();
 }
@@ -324,18 +387,35 @@ struct cmd *parsepipe(char**, char*);
 struct cmd *parseexec(char**, char*);
 struct cmd *nulterminate(struct cmd*);
 
+// The shell parses in its own process, so a bad command
+// line must not exit: errors are noted here instead.
+int parseerr;
+
+void
+syntax(char *msg)
+{
+  printf(2, "%s\n", msg);
+  parseerr = 1;
+}
+
+// Returns 0 if s is not a valid command.
 struct cmd*
 parsecmd(char *s)
 {
   char *es;
   struct cmd *cmd;
 
+  parseerr = 0;
   es = s + strlen(s);
   cmd = parseline(&s, es);
   peek(&s, es, "");
-  if(s != es){
+  if(s != es && !parseerr){
     printf(2, "leftovers: %s\n", s);
-    panic("syntax");
+    syntax("syntax");
+  }
+  if(parseerr){
+    freecmd(cmd);
+    return 0;
   }
   nulterminate(cmd);
   return cmd;
@@ -379,8 +459,10 @@ parseredirs(struct cmd *cmd, char **ps, char *es)
 
   while(peek(ps, es, "<>")){
     tok = gettoken(ps, es, 0, 0);
-    if(gettoken(ps, es, &q, &eq) != 'a')
-      panic("missing file for redirection");
+    if(gettoken(ps, es, &q, &eq) != 'a'){
+      syntax("missing file for redirection");
+      break;
+    }
     switch(tok){
     case '<':
       cmd = redircmd(cmd, q, eq, O_RDONLY, 0);
@@ -405,8 +487,10 @@ parseblock(char **ps, char *es)
     panic("parseblock");
   gettoken(ps, es, 0, 0);
   cmd = parseline(ps, es);
-  if(!peek(ps, es, ")"))
-    panic("syntax - missing )");
+  if(!peek(ps, es, ")")){
+    syntax("syntax - missing )");
+    return cmd;
+  }
   gettoken(ps, es, 0, 0);
   cmd = parseredirs(cmd, ps, es);
   return cmd;
@@ -431,13 +515,17 @@ parseexec(char **ps, char *es)
   while(!peek(ps, es, "|)&;")){
     if((tok=gettoken(ps, es, &q, &eq)) == 0)
       break;
-    if(tok != 'a')
-      panic("syntax");
+    if(tok != 'a'){
+      syntax("syntax");
+      break;
+    }
+    if(argc >= MAXARGS-1){
+      syntax("too many args");
+      break;
+    }
     cmd->argv[argc] = q;
     cmd->eargv[argc] = eq;
     argc++;
-    if(argc >= MAXARGS)
-      panic("too many args");
     ret = parseredirs(ret, ps, es);
   }
   cmd->argv[argc] = 0;
@@ -491,3 +579,32 @@ nulterminate(struct cmd *cmd)
   }
   return cmd;
 }
+
+// Free the nodes of a parsed command.
+void
+freecmd(struct cmd *cmd)
+{
+  if(cmd == 0)
+    return;
+
+  switch(cmd->type){
+  case REDIR:
+    freecmd(((struct redircmd*)cmd)->cmd);
+    break;
+
+  case PIPE:
+    freecmd(((struct pipecmd*)cmd)->left);
+    freecmd(((struct pipecmd*)cmd)->right);
+    break;
+
+  case LIST:
+    freecmd(((struct listcmd*)cmd)->left);
+    freecmd(((struct listcmd*)cmd)->right);
+    break;
+
+  case BACK:
+    freecmd(((struct backcmd*)cmd)->cmd);
+    break;
+  }
+  free(cmd);
+}
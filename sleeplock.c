@@ -31,6 +31,23 @@ acquiresleep(struct sleeplock *lk)
   release(&lk->lk);
 }
 
+// Acquire the lock only if it is free.
+// Returns 1 if acquired, 0 if someone else holds it.
+int
+tryacquiresleep(struct sleeplock *lk)
+{
+  int r;
+
+  acquire(&lk->lk);
+  r = !lk->locked;
+  if(r){
+    lk->locked = 1;
+    lk->pid = myproc()->pid;
+  }
+  release(&lk->lk);
+  return r;
+}
+
 void
 releasesleep(struct sleeplock *lk)
 {
@@ -6,19 +6,38 @@
 // after about 5 runs of stressfs in QEMU on a 2.1GHz CPU:
 //    for (i = 0; i < 40000; i++)
 //      asm volatile("");
+//
+// Usage: stressfs [fifo|clook|deadline] runs under the given I/O
+// scheduler and prints the disk queue statistics at the end.
 
 #include "types.h"
 #include "stat.h"
 #include "user.h"
 #include "fs.h"
 #include "fcntl.h"
+#include "sysinfo.h"
+
+char *policies[] = { "fifo", "clook", "deadline" };
+#define NPOLICY (sizeof(policies)/sizeof(policies[0]))
 
 int
 main(int argc, char *argv[])
 {
-  int fd, i;
+  int fd, i, id;
   char path[] = "stressfs0";
   char data[512];
+  struct sysinfo info;
+
+  if(argc > 1){
+    for(i = 0; i < NPOLICY; i++)
+      if(strcmp(argv[1], policies[i]) == 0)
+        break;
+    if(i == NPOLICY){
+      printf(2, "usage: stressfs [fifo|clook|deadline]\n");
+      exit();
+    }
+    iosched(i);
+  }
 
   printf(1, "stressfs starting\n");
   memset(data, 'a', sizeof(data));
@@ -27,6 +46,7 @@ main(int argc, char *argv[])
     if(fork() > 0)
       break;
 
+  id = i;
   printf(1, "write %d\n", i);
 
   path[8] += i;
@@ -45,5 +65,14 @@ main(int argc, char *argv[])
 
   wait();
 
+  if(id == 0 && getsysinfo(&info) == 0){
+    printf(1, "%s: %d requests in %d commands, max depth %d",
+           policies[info.ide.sched], info.ide.requests,
+           info.ide.commands, info.ide.maxdepth);
+    if(info.ide.requests > 0)
+      printf(1, ", avg wait %d ticks", info.ide.waitticks / info.ide.requests);
+    printf(1, ", max wait %d ticks\n", info.ide.maxwait);
+  }
+
   exit();
 }
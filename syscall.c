@@ -21,6 +21,8 @@ fetchint(uint addr, int *ip)
 
   if(addr >= curproc->sz || addr+4 > curproc->sz)
     return -1;
+  if(uvmready(addr, 4, 0) < 0)
+    return -1;
   *ip = *(int*)(addr);
   return 0;
 }
@@ -39,6 +41,8 @@ fetchstr(uint addr, char **pp)
   *pp = (char*)addr;
   ep = (char*)curproc->sz;
   for(s = *pp; s < ep; s++){
+    if((s == *pp || (uint)s % PGSIZE == 0) && uvmready((uint)s, 1, 0) < 0)
+      return -1;
     if(*s == 0)
       return s - *pp;
   }
@@ -52,11 +56,8 @@ argint(int n, int *ip)
   return fetchint((myproc()->tf->esp) + 4 + 4*n, ip);
 }
 
-// Fetch the nth word-sized system call argument as a pointer
-// to a block of memory of size bytes.  Check that the pointer
-// lies within the process address space.
-int
-argptr(int n, char **pp, int size)
+static int
+argbuf(int n, char **pp, int size, int write)
 {
   int i;
   struct proc *curproc = myproc();
@@ -65,10 +66,28 @@ argptr(int n, char **pp, int size)
     return -1;
   if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
     return -1;
+  if(uvmready(i, size, write) < 0)
+    return -1;
   *pp = (char*)i;
   return 0;
 }
 
+// Fetch the nth word-sized system call argument as a pointer
+// to a block of memory of size bytes.  Check that the pointer
+// lies within the process address space.
+int
+argptr(int n, char **pp, int size)
+{
+  return argbuf(n, pp, size, 0);
+}
+
+// Like argptr(), for memory the system call will write.
+int
+argoutptr(int n, char **pp, int size)
+{
+  return argbuf(n, pp, size, 1);
+}
+
 // Fetch the nth word-sized system call argument as a string pointer.
 // Check that the pointer is valid and the string is nul-terminated.
 // (There is no shared writable memory, so the string can't change
@@ -110,6 +129,17 @@ extern int sys_getprocinfo(void);
 extern int sys_getmeminfo(void);
 extern int sys_getsyscallstats(void);
 
+// Scheduler syscalls
+extern int sys_getlevel(void);
+extern int sys_setlevel(void);
+
+// Disk syscalls
+extern int sys_iosched(void);
+extern int sys_fsync(void);
+
+// Process syscalls
+extern int sys_spawn(void);
+
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
 [SYS_exit]    sys_exit,
@@ -137,6 +167,14 @@ static int (*syscalls[])(void) = {
 [SYS_getprocinfo]    sys_getprocinfo,
 [SYS_getmeminfo]     sys_getmeminfo,
 [SYS_getsyscallstats] sys_getsyscallstats,
+// Scheduler syscalls
+[SYS_getlevel]       sys_getlevel,
+[SYS_setlevel]       sys_setlevel,
+// Disk syscalls
+[SYS_iosched]        sys_iosched,
+[SYS_fsync]          sys_fsync,
+// Process syscalls
+[SYS_spawn]          sys_spawn,
 };
 
 void
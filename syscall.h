@@ -26,3 +26,14 @@
 #define SYS_getprocinfo    23  // Get process list
 #define SYS_getmeminfo     24  // Get memory info
 #define SYS_getsyscallstats 25 // Get syscall statistics
+
+// Scheduler system calls
+#define SYS_getlevel       26  // Get a process's MLFQ level
+#define SYS_setlevel       27  // Set a process's MLFQ level
+
+// Disk system calls
+#define SYS_iosched        28  // Set the IDE I/O scheduler
+#define SYS_fsync          29  // Wait for a file's updates to reach the disk
+
+// Process system calls
+#define SYS_spawn          30  // Run a program in a new process without fork
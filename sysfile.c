@@ -73,7 +73,7 @@ sys_read(void)
   int n;
   char *p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argoutptr(1, &p, n) < 0)
     return -1;
   return fileread(f, p, n);
 }
@@ -109,11 +109,22 @@ sys_fstat(void)
   struct file *f;
   struct stat *st;
 
-  if(argfd(0, 0, &f) < 0 || argptr(1, (void*)&st, sizeof(*st)) < 0)
+  if(argfd(0, 0, &f) < 0 || argoutptr(1, (void*)&st, sizeof(*st)) < 0)
     return -1;
   return filestat(f, st);
 }
 
+// Wait until the updates to the file, and every other
+// finished FS system call, are on disk.
+int
+sys_fsync(void)
+{
+  if(argfd(0, 0, 0) < 0)
+    return -1;
+  log_sync();
+  return 0;
+}
+
 // Create the path new as a link to the same inode as old.
 int
 sys_link(void)
@@ -124,16 +135,16 @@ sys_link(void)
   if(argstr(0, &old) < 0 || argstr(1, &new) < 0)
     return -1;
 
-  begin_op();
+  begin_opn(DIROPBLOCKS);
   if((ip = namei(old)) == 0){
-    end_op();
+    end_opn(DIROPBLOCKS);
     return -1;
   }
 
   ilock(ip);
   if(ip->type == T_DIR){
     iunlockput(ip);
-    end_op();
+    end_opn(DIROPBLOCKS);
     return -1;
   }
 
@@ -151,7 +162,7 @@ sys_link(void)
   iunlockput(dp);
   iput(ip);
 
-  end_op();
+  end_opn(DIROPBLOCKS);
 
   return 0;
 
@@ -160,21 +171,23 @@ bad:
   ip->nlink--;
   iupdate(ip);
   iunlockput(ip);
-  end_op();
+  end_opn(DIROPBLOCKS);
   return -1;
 }
 
 // Is the directory dp empty except for "." and ".." ?
+// A hashed directory keeps them wherever they hash to.
 static int
 isdirempty(struct inode *dp)
 {
   int off;
   struct dirent de;
 
-  for(off=2*sizeof(de); off<dp->size; off+=sizeof(de)){
+  for(off=0; off<dp->size; off+=sizeof(de)){
     if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
       panic("isdirempty: readi");
-    if(de.inum != 0)
+    if(de.inum != 0 && namecmp(de.name, ".") != 0 &&
+       namecmp(de.name, "..") != 0)
       return 0;
   }
   return 1;
@@ -185,7 +198,6 @@ int
 sys_unlink(void)
 {
   struct inode *ip, *dp;
-  struct dirent de;
   char name[DIRSIZ], *path;
   uint off;
 
@@ -215,9 +227,7 @@ sys_unlink(void)
     goto bad;
   }
 
-  memset(&de, 0, sizeof(de));
-  if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
-    panic("unlink: writei");
+  dirunlink(dp, name, off);
   if(ip->type == T_DIR){
     dp->nlink--;
     iupdate(dp);
@@ -271,45 +281,60 @@ create(char *path, short type, short major, short minor)
     iupdate(dp);
     // No ip->nlink++ for ".": avoid cyclic ref count.
     if(dirlink(ip, ".", ip->inum) < 0 || dirlink(ip, "..", dp->inum) < 0)
-      panic("create dots");
+      goto undo;
   }
 
   if(dirlink(dp, name, ip->inum) < 0)
-    panic("create: dirlink");
+    goto undo;
 
   iunlockput(dp);
 
   return ip;
+
+undo:
+  // No room for name in dp (see dirsplit), or for the dots
+  // in a new directory on a full disk.
+  if(type == T_DIR){
+    dp->nlink--;
+    iupdate(dp);
+  }
+  ip->nlink = 0;
+  iupdate(ip);
+  iunlockput(ip);
+  iunlockput(dp);
+  return 0;
 }
 
 int
 sys_open(void)
 {
   char *path;
-  int fd, omode;
+  int fd, omode, nblocks;
   struct file *f;
   struct inode *ip;
 
   if(argstr(0, &path) < 0 || argint(1, &omode) < 0)
     return -1;
 
-  begin_op();
+  // Creating the file adds a name to its directory.
+  nblocks = (omode & O_CREATE) ? DIROPBLOCKS : MAXOPBLOCKS;
+  begin_opn(nblocks);
 
   if(omode & O_CREATE){
     ip = create(path, T_FILE, 0, 0);
     if(ip == 0){
-      end_op();
+      end_opn(nblocks);
       return -1;
     }
   } else {
     if((ip = namei(path)) == 0){
-      end_op();
+      end_opn(nblocks);
       return -1;
     }
     ilock(ip);
     if(ip->type == T_DIR && omode != O_RDONLY){
       iunlockput(ip);
-      end_op();
+      end_opn(nblocks);
       return -1;
     }
   }
@@ -318,11 +343,11 @@ sys_open(void)
     if(f)
       fileclose(f);
     iunlockput(ip);
-    end_op();
+    end_opn(nblocks);
     return -1;
   }
   iunlock(ip);
-  end_op();
+  end_opn(nblocks);
 
   f->type = FD_INODE;
   f->ip = ip;
@@ -338,13 +363,13 @@ sys_mkdir(void)
   char *path;
   struct inode *ip;
 
-  begin_op();
+  begin_opn(DIROPBLOCKS);
   if(argstr(0, &path) < 0 || (ip = create(path, T_DIR, 0, 0)) == 0){
-    end_op();
+    end_opn(DIROPBLOCKS);
     return -1;
   }
   iunlockput(ip);
-  end_op();
+  end_opn(DIROPBLOCKS);
   return 0;
 }
 
@@ -355,16 +380,16 @@ sys_mknod(void)
   char *path;
   int major, minor;
 
-  begin_op();
+  begin_opn(DIROPBLOCKS);
   if((argstr(0, &path)) < 0 ||
      argint(1, &major) < 0 ||
      argint(2, &minor) < 0 ||
      (ip = create(path, T_DEV, major, minor)) == 0){
-    end_op();
+    end_opn(DIROPBLOCKS);
     return -1;
   }
   iunlockput(ip);
-  end_op();
+  end_opn(DIROPBLOCKS);
   return 0;
 }
 
@@ -393,19 +418,16 @@ sys_chdir(void)
   return 0;
 }
 
-int
-sys_exec(void)
+// Fetch the user argv array at uargv into argv.
+static int
+fetchargv(uint uargv, char **argv)
 {
-  char *path, *argv[MAXARG];
   int i;
-  uint uargv, uarg;
+  uint uarg;
 
-  if(argstr(0, &path) < 0 || argint(1, (int*)&uargv) < 0){
-    return -1;
-  }
-  memset(argv, 0, sizeof(argv));
+  memset(argv, 0, MAXARG*sizeof(argv[0]));
   for(i=0;; i++){
-    if(i >= NELEM(argv))
+    if(i >= MAXARG)
       return -1;
     if(fetchint(uargv+4*i, (int*)&uarg) < 0)
       return -1;
@@ -416,9 +438,52 @@ sys_exec(void)
     if(fetchstr(uarg, &argv[i]) < 0)
       return -1;
   }
+  return 0;
+}
+
+int
+sys_exec(void)
+{
+  char *path, *argv[MAXARG];
+  uint uargv;
+
+  if(argstr(0, &path) < 0 || argint(1, (int*)&uargv) < 0){
+    return -1;
+  }
+  if(fetchargv(uargv, argv) < 0)
+    return -1;
   return exec(path, argv);
 }
 
+// spawn(path, argv, fd): run path in a new process whose
+// descriptors 0-2 are the caller's fd[0]-fd[2] (-1 for
+// none), or the caller's own 0-2 if fd is null.
+int
+sys_spawn(void)
+{
+  char *path, *argv[MAXARG];
+  uint uargv;
+  int i, *fd;
+  struct file *f[3];
+
+  if(argstr(0, &path) < 0 || argint(1, (int*)&uargv) < 0 ||
+     argint(2, (int*)&fd) < 0)
+    return -1;
+  if(fetchargv(uargv, argv) < 0)
+    return -1;
+  if(fd && argptr(2, (char**)&fd, 3*sizeof(int)) < 0)
+    return -1;
+  for(i = 0; i < 3; i++){
+    if(fd == 0)
+      f[i] = myproc()->ofile[i];
+    else if(fd[i] < 0)
+      f[i] = 0;
+    else if(fd[i] >= NOFILE || (f[i] = myproc()->ofile[fd[i]]) == 0)
+      return -1;
+  }
+  return spawn(path, argv, f);
+}
+
 int
 sys_pipe(void)
 {
@@ -426,7 +491,7 @@ sys_pipe(void)
   struct file *rf, *wf;
   int fd0, fd1;
 
-  if(argptr(0, (void*)&fd, 2*sizeof(fd[0])) < 0)
+  if(argoutptr(0, (void*)&fd, 2*sizeof(fd[0])) < 0)
     return -1;
   if(pipealloc(&rf, &wf) < 0)
     return -1;
@@ -22,6 +22,11 @@ char *state_names[] = {
   "ZOMBIE  "
 };
 
+// I/O scheduler names, indexed by IOSCHED_*
+char *iosched_names[] = {
+  "fifo", "clook", "deadline"
+};
+
 // System call names
 char *syscall_names[] = {
   "",        "fork",   "exit",   "wait",   "pipe",
@@ -64,6 +69,32 @@ print_sysinfo(struct sysinfo *info)
   printf(1, "  SLEEPING (blocked):       %d\n", info->procq.sleeping_count);
   printf(1, "  ZOMBIE   (waiting reap):  %d\n", info->procq.zombie_count);
   printf(1, "\n");
+
+  printf(1, "--- BUFFER CACHE ---\n");
+  printf(1, "Buffers: %d (%d pages grown)\n", info->bcache.nbuf, info->bcache.npages);
+  printf(1, "Hits: %d  Misses: %d", info->bcache.hits, info->bcache.misses);
+  if(info->bcache.hits + info->bcache.misses > 0)
+    printf(1, "  Hit rate: %d%%", (info->bcache.hits * 100) /
+           (info->bcache.hits + info->bcache.misses));
+  printf(1, "\n");
+  printf(1, "Evictions: %d  Grows: %d  Shrinks: %d  Read-ahead: %d\n",
+         info->bcache.evictions, info->bcache.grows, info->bcache.shrinks,
+         info->bcache.readahead);
+  printf(1, "\n");
+
+  printf(1, "--- DISK QUEUE ---\n");
+  printf(1, "Scheduler: %s  Transfer: %s\n", iosched_names[info->ide.sched],
+         info->ide.dma ? "DMA" : "PIO");
+  printf(1, "Requests: %d  Commands: %d  Queued: %d (max %d)\n",
+         info->ide.requests, info->ide.commands, info->ide.depth,
+         info->ide.maxdepth);
+  if(info->ide.requests > 0)
+    printf(1, "Avg depth: %d  Avg wait: %d ticks  ",
+           info->ide.sumdepth / info->ide.requests,
+           info->ide.waitticks / info->ide.requests);
+  printf(1, "Max wait: %d ticks  Deadline expiries: %d\n",
+         info->ide.maxwait, info->ide.expired);
+  printf(1, "\n");
 }
 
 void
@@ -76,16 +107,17 @@ print_proclist(void)
   count = getprocinfo(procs, 64);
   
   printf(1, "--- PROCESS LIST ---\n");
-  printf(1, "PID   PPID  STATE     SIZE(KB)  NAME\n");
-  printf(1, "----  ----  --------  --------  ----------------\n");
+  printf(1, "PID   PPID  STATE     LVL  SIZE(KB)  NAME\n");
+  printf(1, "----  ----  --------  ---  --------  ----------------\n");
   
   for(i = 0; i < count; i++) {
     state = (procs[i].state >= 0 && procs[i].state <= 5) 
                   ? state_names[procs[i].state] : "???     ";
-    printf(1, "%d\t%d\t%s  %d\t%s\n",
+    printf(1, "%d\t%d\t%s  %d    %d\t%s\n",
            procs[i].pid,
            procs[i].ppid,
            state,
+           procs[i].level,
            procs[i].sz / 1024,
            procs[i].name);
   }
@@ -105,6 +137,9 @@ print_meminfo(void)
   printf(1, "Total pages:   %d\n", mem.total_pages);
   printf(1, "Free pages:    %d\n", mem.free_pages);
   printf(1, "Used pages:    %d\n", mem.used_pages);
+  printf(1, "Zero faults:   %d\n", mem.zero_faults);
+  printf(1, "COW faults:    %d\n", mem.cow_faults);
+  printf(1, "File faults:   %d\n", mem.file_faults);
   printf(1, "\n");
   
   // Visual memory bar
@@ -16,6 +16,7 @@ struct procinfo {
   uint sz;                     // Memory size in bytes
   void *chan;                  // Sleep channel (if sleeping)
   int killed;                  // Killed flag
+  int level;                   // MLFQ priority level
 };
 
 // Memory information structure
@@ -25,6 +26,9 @@ struct meminfo {
   uint used_pages;             // Used pages count
   uint page_size;              // Size of each page (4096 bytes)
   uint kernel_end;             // End of kernel in memory
+  uint zero_faults;            // Heap pages allocated on first touch
+  uint cow_faults;             // Shared pages copied on write
+  uint file_faults;            // Program pages read in on first touch
 };
 
 // CPU information structure
@@ -53,12 +57,73 @@ struct syscallstats {
   uint calls[30];              // Per-syscall counts (indexed by syscall number)
 };
 
+// Buffer cache statistics
+struct bcacheinfo {
+  uint nbuf;                   // Buffers currently in the cache
+  uint npages;                 // kalloc pages the cache has grown into
+  uint hits;                   // Lookups found in the cache
+  uint misses;                 // Lookups that needed a buffer
+  uint evictions;              // Cached blocks recycled for others
+  uint grows;                  // Pages taken from kalloc
+  uint shrinks;                // Pages given back to kalloc
+  uint readahead;              // Blocks read ahead of readi()
+};
+
+// IDE I/O scheduler policies
+#define IOSCHED_FIFO     0     // Arrival order
+#define IOSCHED_CLOOK    1     // C-LOOK elevator
+#define IOSCHED_DEADLINE 2     // C-LOOK with a wait deadline
+
+// IDE request queue statistics, since the policy was last set
+struct ideinfo {
+  int sched;                   // I/O scheduler policy (IOSCHED_*)
+  int dma;                     // Transfers by bus-master DMA, not PIO?
+  uint requests;               // Requests queued
+  uint commands;               // Disk commands issued (requests merge)
+  uint depth;                  // Requests now queued
+  uint maxdepth;               // Most requests queued at once
+  uint sumdepth;               // Queue depth seen by each new request
+  uint waitticks;              // Ticks from queueing to completion, summed
+  uint maxwait;                // Longest wait in ticks
+  uint expired;                // Requests that hit the deadline
+};
+
+// Log commit statistics
+struct loginfo {
+  uint size;                   // Log blocks on disk, with the header
+  uint cap;                    // Most blocks in one transaction
+  uint commits;                // Transactions committed
+  uint logged;                 // Blocks committed
+  uint absorbed;               // Writes absorbed into an already logged block
+  uint inodeblocks;            // Committed blocks holding inodes
+  uint bitmapblocks;           // Committed free-map blocks
+  uint datablocks;             // Committed data and directory blocks
+  uint bytes;                  // Bytes written by commits
+  uint ticks;                  // Commit latency, summed
+  uint maxticks;               // Slowest commit
+  uint maxlogged;              // Biggest commit
+  uint lastlogged;             // Blocks in the last commit
+  uint lastabsorbed;           // Writes absorbed in the last commit
+  uint lastticks;              // Latency of the last commit
+};
+
+// File system space
+struct fsinfo {
+  uint size;                   // Blocks in the file system
+  uint nblocks;                // Data blocks
+  uint nfree;                  // Free blocks
+};
+
 // Complete system information structure
 struct sysinfo {
   uint uptime;                 // System uptime in ticks
   struct meminfo mem;          // Memory information
   struct procqueue procq;      // Process queue statistics
   int ncpu;                    // Number of CPUs
+  struct bcacheinfo bcache;    // Buffer cache statistics
+  struct ideinfo ide;          // Disk queue statistics
+  struct loginfo log;          // Log commit statistics
+  struct fsinfo fs;            // File system space
 };
 
 // State name strings for display
@@ -63,6 +63,7 @@ getmeminfo(struct meminfo *info)
   info->free_pages = kfreepages();
   info->total_pages = ktotalpages();
   info->used_pages = info->total_pages - info->free_pages;
+  faultstats(info);
 }
 
 // Get process queue statistics
@@ -120,6 +121,7 @@ getprocinfo(struct procinfo *procs, int max)
       procs[count].sz = p->sz;
       procs[count].chan = p->chan;
       procs[count].killed = p->killed;
+      procs[count].level = p->level;
       safestrcpy(procs[count].name, p->name, sizeof(procs[count].name));
       count++;
     }
@@ -165,6 +167,10 @@ getsysinfo(struct sysinfo *info)
   getmeminfo(&info->mem);
   getprocqueue(&info->procq);
   info->ncpu = ncpu;
+  bcachestats(&info->bcache);
+  idestats(&info->ide);
+  logstats(&info->log);
+  fsstats(&info->fs);
 }
 
 // Get system call statistics
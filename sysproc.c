@@ -99,7 +99,7 @@ sys_getsysinfo(void)
 {
   struct sysinfo *info;
   
-  if(argptr(0, (char**)&info, sizeof(*info)) < 0)
+  if(argoutptr(0, (char**)&info, sizeof(*info)) < 0)
     return -1;
   
   getsysinfo(info);
@@ -113,9 +113,11 @@ sys_getprocinfo(void)
   struct procinfo *procs;
   int max;
   
-  if(argptr(0, (char**)&procs, sizeof(*procs)) < 0)
+  if(argint(1, &max) < 0 || max < 0)
     return -1;
-  if(argint(1, &max) < 0)
+  if(max > NPROC)
+    max = NPROC;
+  if(argoutptr(0, (char**)&procs, max*sizeof(*procs)) < 0)
     return -1;
   
   return getprocinfo(procs, max);
@@ -127,7 +129,7 @@ sys_getmeminfo(void)
 {
   struct meminfo *info;
   
-  if(argptr(0, (char**)&info, sizeof(*info)) < 0)
+  if(argoutptr(0, (char**)&info, sizeof(*info)) < 0)
     return -1;
   
   getmeminfo(info);
@@ -140,9 +142,46 @@ sys_getsyscallstats(void)
 {
   struct syscallstats *stats;
   
-  if(argptr(0, (char**)&stats, sizeof(*stats)) < 0)
+  if(argoutptr(0, (char**)&stats, sizeof(*stats)) < 0)
     return -1;
   
   getsyscallstats(stats);
   return 0;
 }
+
+// Scheduler system calls
+
+// Get the MLFQ priority level of a process
+int
+sys_getlevel(void)
+{
+  int pid;
+
+  if(argint(0, &pid) < 0)
+    return -1;
+  return getlevel(pid);
+}
+
+// Set the MLFQ priority level of a process
+int
+sys_setlevel(void)
+{
+  int pid, level;
+
+  if(argint(0, &pid) < 0 || argint(1, &level) < 0)
+    return -1;
+  return setlevel(pid, level);
+}
+
+// Disk system calls
+
+// Select the IDE I/O scheduler policy; -1 only queries it.
+int
+sys_iosched(void)
+{
+  int policy;
+
+  if(argint(0, &policy) < 0)
+    return -1;
+  return setiosched(policy);
+}
@@ -34,6 +34,17 @@ int getprocinfo(struct procinfo*, int);
 int getmeminfo(struct meminfo*);
 int getsyscallstats(struct syscallstats*);
 
+// Scheduler system calls
+int getlevel(int);
+int setlevel(int, int);
+
+// Disk system calls
+int iosched(int);
+int fsync(int);
+
+// Process system calls
+int spawn(char*, char**, int*);
+
 // ulib.c
 int stat(const char*, struct stat*);
 char* strcpy(char*, const char*);
@@ -7,6 +7,7 @@
 #include "syscall.h"
 #include "traps.h"
 #include "memlayout.h"
+#include "sysinfo.h"
 
 char buf[8192];
 char name[3];
@@ -300,6 +301,266 @@ exectest(void)
   }
 }
 
+// exec() pages programs in as they are touched, and their
+// text is read-only.
+void
+demandtest(void)
+{
+  struct meminfo m0, m1;
+  int fds[2], pid;
+  char *argv[] = { "echo", 0 };
+
+  printf(stdout, "demand paging test\n");
+  getmeminfo(&m0);
+  if((pid = spawn("echo", argv, 0)) < 0){
+    printf(stdout, "demand paging test: spawn failed\n");
+    exit();
+  }
+  wait();
+  getmeminfo(&m1);
+  if(m1.file_faults == m0.file_faults){
+    printf(stdout, "demand paging test: echo ran without faults\n");
+    exit();
+  }
+
+  if(pipe(fds) != 0){
+    printf(stdout, "demand paging test: pipe failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "demand paging test: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    close(fds[0]);
+    *(volatile char*)demandtest = 0;
+    write(fds[1], "x", 1);
+    exit();
+  }
+  close(fds[1]);
+  if(read(fds[0], buf, 1) != 0){
+    printf(stdout, "demand paging test: wrote program text\n");
+    exit();
+  }
+  close(fds[0]);
+  wait();
+  printf(stdout, "demand paging test OK\n");
+}
+
+// Check that the n bytes from fd are c, and fail the test
+// named what if not.
+void
+pccheck(int fd, int n, char c, char *what)
+{
+  int i;
+
+  if(read(fd, buf, n) != n){
+    printf(stdout, "%s: short read\n", what);
+    exit();
+  }
+  for(i = 0; i < n; i++){
+    if(buf[i] != c){
+      printf(stdout, "%s: byte %d is %c, not %c\n", what, i, buf[i], c);
+      exit();
+    }
+  }
+}
+
+// File data goes through the page cache: writes through
+// one descriptor must show in pages already cached for
+// another, and a file recreated after unlink must not
+// see the old file's pages.
+void
+pcachetest(void)
+{
+  int fd, rfd;
+
+  printf(stdout, "page cache test\n");
+
+  fd = open("pcf", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(stdout, "page cache test: create failed\n");
+    exit();
+  }
+  memset(buf, 'a', sizeof(buf));
+  if(write(fd, buf, 8192) != 8192){
+    printf(stdout, "page cache test: write failed\n");
+    exit();
+  }
+  close(fd);
+
+  // Cache both pages.
+  rfd = open("pcf", O_RDONLY);
+  pccheck(rfd, 8192, 'a', "page cache test: first read");
+  close(rfd);
+
+  // Overwrite part of the first page, and a run that
+  // crosses into the second.
+  fd = open("pcf", O_RDWR);
+  memset(buf, 'b', 100);
+  if(write(fd, buf, 100) != 100){
+    printf(stdout, "page cache test: write failed\n");
+    exit();
+  }
+  pccheck(fd, 4000 - 100, 'a', "page cache test: read between writes");
+  memset(buf, 'c', 200);
+  if(write(fd, buf, 200) != 200){
+    printf(stdout, "page cache test: write failed\n");
+    exit();
+  }
+
+  rfd = open("pcf", O_RDONLY);
+  pccheck(rfd, 100, 'b', "page cache test: partial page");
+  pccheck(rfd, 4000 - 100, 'a', "page cache test: rest of page");
+  pccheck(rfd, 200, 'c', "page cache test: across pages");
+  pccheck(rfd, 8192 - 4200, 'a', "page cache test: second page");
+  if(read(rfd, buf, 1) != 0){
+    printf(stdout, "page cache test: read past end\n");
+    exit();
+  }
+  close(rfd);
+  close(fd);
+
+  // A new file, likely with the same inode, must not
+  // read the old one's cached pages.
+  if(unlink("pcf") < 0){
+    printf(stdout, "page cache test: unlink failed\n");
+    exit();
+  }
+  fd = open("pcf", O_CREATE|O_RDWR);
+  memset(buf, 'z', 512);
+  if(fd < 0 || write(fd, buf, 512) != 512){
+    printf(stdout, "page cache test: recreate failed\n");
+    exit();
+  }
+  close(fd);
+  rfd = open("pcf", O_RDONLY);
+  pccheck(rfd, 512, 'z', "page cache test: recreated file");
+  if(read(rfd, buf, 512) != 0){
+    printf(stdout, "page cache test: old data after unlink\n");
+    exit();
+  }
+  close(rfd);
+  unlink("pcf");
+
+  printf(stdout, "page cache test OK\n");
+}
+
+// A program file can't be written while it runs: the
+// process's pages come from it.  Copy cat, start it
+// reading a pipe, try to overwrite it, then check that
+// it still copies its input, and that the file can be
+// written once it exits.
+void
+texttest(void)
+{
+  char *argv[] = { "catcp", 0 };
+  int fd, cp, in[2], out[2], fds[3], n, i;
+
+  printf(stdout, "text busy test\n");
+  if((fd = open("cat", O_RDONLY)) < 0){
+    printf(stdout, "text busy test: open cat failed\n");
+    exit();
+  }
+  cp = open("catcp", O_CREATE|O_RDWR);
+  if(cp < 0){
+    printf(stdout, "text busy test: create failed\n");
+    exit();
+  }
+  while((n = read(fd, buf, sizeof(buf))) > 0){
+    if(write(cp, buf, n) != n){
+      printf(stdout, "text busy test: copy failed\n");
+      exit();
+    }
+  }
+  close(fd);
+  close(cp);
+
+  if(pipe(in) != 0 || pipe(out) != 0){
+    printf(stdout, "text busy test: pipe failed\n");
+    exit();
+  }
+  fds[0] = in[0];
+  fds[1] = out[1];
+  fds[2] = 2;
+  if(spawn("catcp", argv, fds) < 0){
+    printf(stdout, "text busy test: spawn failed\n");
+    exit();
+  }
+  close(in[0]);
+  close(out[1]);
+
+  fd = open("catcp", O_RDWR);
+  memset(buf, 0, 512);
+  if(fd < 0 || write(fd, buf, 512) >= 0){
+    printf(stdout, "text busy test: overwrote a running program\n");
+    exit();
+  }
+
+  if(write(in[1], "still here", 10) != 10){
+    printf(stdout, "text busy test: write to pipe failed\n");
+    exit();
+  }
+  close(in[1]);
+  for(i = 0; i < 10; i += n){
+    if((n = read(out[0], buf + i, 10 - i)) <= 0)
+      break;
+  }
+  close(out[0]);
+  wait();
+  buf[i] = '\0';
+  if(strcmp(buf, "still here") != 0){
+    printf(stdout, "text busy test: program did not run\n");
+    exit();
+  }
+
+  if(write(fd, buf, 512) != 512){
+    printf(stdout, "text busy test: write after exit failed\n");
+    exit();
+  }
+  close(fd);
+  unlink("catcp");
+  printf(stdout, "text busy test OK\n");
+}
+
+// spawn() a program with its stdout on a pipe, without fork.
+void
+spawntest(void)
+{
+  char *argv[] = { "echo", "spawned", 0 };
+  char buf[32];
+  int fds[2], fd[3], pid, n, i;
+
+  printf(stdout, "spawn test\n");
+  if(pipe(fds) != 0){
+    printf(stdout, "spawn test pipe failed\n");
+    exit();
+  }
+  fd[0] = -1;
+  fd[1] = fds[1];
+  fd[2] = 2;
+  if((pid = spawn("echo", argv, fd)) < 0){
+    printf(stdout, "spawn echo failed\n");
+    exit();
+  }
+  close(fds[1]);
+  n = 0;
+  while((i = read(fds[0], buf + n, sizeof(buf) - 1 - n)) > 0)
+    n += i;
+  buf[n] = 0;
+  close(fds[0]);
+  if(wait() != pid || strcmp(buf, "spawned\n") != 0){
+    printf(stdout, "spawn test got '%s'\n", buf);
+    exit();
+  }
+  if(spawn("nosuchprogram", argv, 0) >= 0){
+    printf(stdout, "spawn of a missing program succeeded\n");
+    exit();
+  }
+  printf(stdout, "spawn test OK\n");
+}
+
 // simple fork and pipe read/write
 
 void
@@ -400,6 +661,69 @@ preempt(void)
   printf(1, "preempt ok\n");
 }
 
+// MLFQ: a CPU-bound process sinks to the bottom level, one
+// that mostly sleeps stays up, and the boost every BOOSTTICKS
+// ticks lifts everything back to level 0.
+void
+mlfqtest(void)
+{
+  int pid, i, l, maxl;
+
+  printf(1, "mlfq test\n");
+  pid = getpid();
+  if(setlevel(pid, -1) != -1 || setlevel(pid, NMLFQ) != -1){
+    printf(1, "mlfq: setlevel took a bad level\n");
+    exit();
+  }
+  if(setlevel(pid, 0) != 0 || getlevel(pid) != 0){
+    printf(1, "mlfq: setlevel 0 failed\n");
+    exit();
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf(1, "mlfq: fork failed\n");
+    exit();
+  }
+  if(pid == 0)
+    for(;;)
+      ;
+
+  // Poll once a tick: this process sleeps nearly all the time.
+  maxl = 0;
+  for(i = 0; i < 2*BOOSTTICKS; i++){
+    if(getlevel(pid) == NMLFQ-1)
+      break;
+    sleep(1);
+    if((l = getlevel(getpid())) > maxl)
+      maxl = l;
+  }
+  kill(pid);
+  wait();
+  if(i == 2*BOOSTTICKS){
+    printf(1, "mlfq: CPU-bound child never reached level %d\n", NMLFQ-1);
+    exit();
+  }
+  if(maxl == NMLFQ-1){
+    printf(1, "mlfq: sleeping process sank to level %d\n", maxl);
+    exit();
+  }
+
+  // A sleeping process is not charged, so only the boost
+  // can move it.
+  pid = getpid();
+  if(setlevel(pid, NMLFQ-1) != 0){
+    printf(1, "mlfq: setlevel failed\n");
+    exit();
+  }
+  sleep(BOOSTTICKS + 10);
+  if(getlevel(pid) != 0){
+    printf(1, "mlfq: level %d after a boost\n", getlevel(pid));
+    exit();
+  }
+  printf(1, "mlfq ok\n");
+}
+
 // try to find any races between exit and wait
 void
 exitwait(void)
@@ -459,6 +783,112 @@ mem(void)
 
 // More file system tests
 
+// fsync waits for the log; the data must still be
+// there afterwards, and a bad fd must fail.
+void
+fsynctest(void)
+{
+  int fd, i;
+
+  printf(1, "fsync test\n");
+
+  fd = open("fsyncf", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(1, "fsync test: create failed\n");
+    exit();
+  }
+  for(i = 0; i < 20; i++){
+    memset(buf, 'a'+i, 512);
+    if(write(fd, buf, 512) != 512){
+      printf(1, "fsync test: write failed\n");
+      exit();
+    }
+    if(fsync(fd) != 0){
+      printf(1, "fsync test: fsync failed\n");
+      exit();
+    }
+  }
+  close(fd);
+  if(fsync(fd) >= 0){
+    printf(1, "fsync test: fsync of closed fd succeeded\n");
+    exit();
+  }
+
+  fd = open("fsyncf", O_RDONLY);
+  for(i = 0; i < 20; i++){
+    if(read(fd, buf, 512) != 512 || buf[0] != 'a'+i || buf[511] != 'a'+i){
+      printf(1, "fsync test: wrong data in block %d\n", i);
+      exit();
+    }
+  }
+  close(fd);
+  unlink("fsyncf");
+
+  printf(1, "fsync test ok\n");
+}
+
+// fsync while other processes keep the log busy: each
+// fsync must return even when the flusher is part way
+// through a commit.
+void
+fsyncconc(void)
+{
+  int fd, i, j, pid;
+  char name[3];
+
+  printf(1, "concurrent fsync test\n");
+
+  name[0] = 'y';
+  name[2] = '\0';
+  for(i = 0; i < 3; i++){
+    name[1] = '0' + i;
+    pid = fork();
+    if(pid < 0){
+      printf(1, "fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      fd = open(name, O_CREATE|O_RDWR);
+      if(fd < 0){
+        printf(1, "concurrent fsync test: create failed\n");
+        exit();
+      }
+      memset(buf, 'a'+i, 512);
+      for(j = 0; j < 100; j++){
+        if(write(fd, buf, 512) != 512){
+          printf(1, "concurrent fsync test: write failed\n");
+          exit();
+        }
+      }
+      close(fd);
+      exit();
+    }
+  }
+
+  fd = open("fsyncc", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(1, "concurrent fsync test: create failed\n");
+    exit();
+  }
+  for(i = 0; i < 50; i++){
+    if(write(fd, "x", 1) != 1 || fsync(fd) != 0){
+      printf(1, "concurrent fsync test: write/fsync failed\n");
+      exit();
+    }
+  }
+  close(fd);
+
+  for(i = 0; i < 3; i++)
+    wait();
+  for(i = 0; i < 3; i++){
+    name[1] = '0' + i;
+    unlink(name);
+  }
+  unlink("fsyncc");
+
+  printf(1, "concurrent fsync test ok\n");
+}
+
 // two processes write to the same file descriptor
 // is the offset shared? does inode locking work?
 void
@@ -931,6 +1361,253 @@ bigdir(void)
   printf(1, "bigdir ok\n");
 }
 
+// Give one directory thousands of names and time linking,
+// opening and unlinking them.  A hashed directory reads the
+// same two blocks per name however many it holds.
+void
+dirbench(void)
+{
+  enum { N = 2000 };
+  int i, fd, t0, t1, t2, t3;
+  char path[16];
+
+  printf(1, "dirbench test\n");
+  if(mkdir("db") != 0){
+    printf(1, "dirbench mkdir failed\n");
+    exit();
+  }
+  fd = open("db/f", O_CREATE);
+  if(fd < 0){
+    printf(1, "dirbench create failed\n");
+    exit();
+  }
+  close(fd);
+
+  strcpy(path, "db/n0000");
+  t0 = uptime();
+  for(i = 0; i < N; i++){
+    path[4] = '0' + i / 1000;
+    path[5] = '0' + i / 100 % 10;
+    path[6] = '0' + i / 10 % 10;
+    path[7] = '0' + i % 10;
+    if(link("db/f", path) != 0){
+      printf(1, "dirbench link %s failed\n", path);
+      exit();
+    }
+  }
+  t1 = uptime();
+  for(i = 0; i < N; i++){
+    path[4] = '0' + i / 1000;
+    path[5] = '0' + i / 100 % 10;
+    path[6] = '0' + i / 10 % 10;
+    path[7] = '0' + i % 10;
+    if((fd = open(path, 0)) < 0){
+      printf(1, "dirbench open %s failed\n", path);
+      exit();
+    }
+    close(fd);
+  }
+  if(open("db/nothere", 0) >= 0){
+    printf(1, "dirbench opened a missing name\n");
+    exit();
+  }
+  t2 = uptime();
+  for(i = 0; i < N; i++){
+    path[4] = '0' + i / 1000;
+    path[5] = '0' + i / 100 % 10;
+    path[6] = '0' + i / 10 % 10;
+    path[7] = '0' + i % 10;
+    if(unlink(path) != 0){
+      printf(1, "dirbench unlink %s failed\n", path);
+      exit();
+    }
+  }
+  t3 = uptime();
+
+  if(unlink("db/f") != 0 || unlink("db") != 0){
+    printf(1, "dirbench cleanup failed\n");
+    exit();
+  }
+  printf(1, "dirbench: %d names: link %d, open %d, unlink %d ticks\n",
+         N, t1 - t0, t2 - t1, t3 - t2);
+  printf(1, "dirbench ok\n");
+}
+
+// Fill the disk, then add names to a directory that must
+// grow to take them: first one whose single block is full,
+// which hashing would give a second, and then a hashed one
+// whose leaves split.  Adding a name should fail, not panic,
+// and leave every name already there in place.
+//
+// One file holds at most MAXFILE blocks, so fill the disk
+// with files df00, df01, ... until one comes up short or
+// cannot be created.  Returns how many were created.
+static int
+dirfullfill(void)
+{
+  int fd, n;
+  uint size;
+  char name[8];
+
+  memset(buf, 'f', sizeof(buf));
+  strcpy(name, "df00");
+  for(n = 0; n < 100; n++){
+    name[2] = '0' + n / 10;
+    name[3] = '0' + n % 10;
+    if((fd = open(name, O_CREATE|O_RDWR)) < 0)
+      break;
+    size = 0;
+    while(size + sizeof(buf) <= MAXFILE*BSIZE &&
+          write(fd, buf, sizeof(buf)) == sizeof(buf))
+      size += sizeof(buf);
+    while(write(fd, buf, 512) == 512)
+      size += 512;
+    close(fd);
+    if(size < MAXFILE*BSIZE){
+      n++;
+      break;
+    }
+  }
+  return n;
+}
+
+static void
+dirfullunfill(int n)
+{
+  char name[8];
+
+  strcpy(name, "df00");
+  while(n-- > 0){
+    name[2] = '0' + n / 10;
+    name[3] = '0' + n % 10;
+    if(unlink(name) != 0){
+      printf(1, "dirfull unlink %s failed\n", name);
+      exit();
+    }
+  }
+}
+
+static void
+dirfullname(char *path, char *dir, int i)
+{
+  strcpy(path, dir);
+  path[2] = '/';
+  path[3] = 'n';
+  path[4] = '0' + i / 1000;
+  path[5] = '0' + i / 100 % 10;
+  path[6] = '0' + i / 10 % 10;
+  path[7] = '0' + i % 10;
+  path[8] = '\0';
+}
+
+static void
+dirfullcheck(char *dir, int n)
+{
+  char path[16];
+  int i, fd;
+
+  for(i = 0; i < n; i++){
+    dirfullname(path, dir, i);
+    if((fd = open(path, 0)) < 0){
+      printf(1, "dirfull lost %s\n", path);
+      exit();
+    }
+    close(fd);
+  }
+}
+
+void
+dirfull(void)
+{
+  enum { NPLAIN = 30, NHASH = 200, MAXNAMES = 3000 };
+  int i, n, nfill, fd;
+  char path[16], file[16];
+
+  printf(1, "dirfull test\n");
+  if(mkdir("dp") != 0 || mkdir("dh") != 0){
+    printf(1, "dirfull mkdir failed\n");
+    exit();
+  }
+  fd = open("dfile", O_CREATE);
+  if(fd < 0){
+    printf(1, "dirfull create failed\n");
+    exit();
+  }
+  close(fd);
+  strcpy(file, "dfile");
+
+  // dp: ".", ".." and NPLAIN names fill its one block.
+  for(i = 0; i < NPLAIN; i++){
+    dirfullname(path, "dp", i);
+    if(link(file, path) != 0){
+      printf(1, "dirfull link %s failed\n", path);
+      exit();
+    }
+  }
+  for(i = 0; i < NHASH; i++){
+    dirfullname(path, "dh", i);
+    if(link(file, path) != 0){
+      printf(1, "dirfull link %s failed\n", path);
+      exit();
+    }
+  }
+
+  if((nfill = dirfullfill()) == 0){
+    printf(1, "dirfull wrote nothing\n");
+    exit();
+  }
+
+  if(mkdir("dh/sub") == 0){
+    printf(1, "dirfull mkdir on a full disk succeeded\n");
+    exit();
+  }
+  dirfullname(path, "dp", NPLAIN);
+  if(link(file, path) == 0){
+    printf(1, "dirfull grew a directory on a full disk\n");
+    exit();
+  }
+  dirfullcheck("dp", NPLAIN);
+  for(n = NHASH; n < MAXNAMES; n++){
+    dirfullname(path, "dh", n);
+    if(link(file, path) != 0)
+      break;
+  }
+  if(n == MAXNAMES){
+    printf(1, "dirfull never ran out of blocks\n");
+    exit();
+  }
+  dirfullcheck("dh", n);
+
+  // With room again, both directories can grow.
+  dirfullunfill(nfill);
+  dirfullname(path, "dp", NPLAIN);
+  if(link(file, path) != 0){
+    printf(1, "dirfull link %s failed after freeing space\n", path);
+    exit();
+  }
+  dirfullcheck("dp", NPLAIN+1);
+  dirfullname(path, "dh", n);
+  if(link(file, path) != 0){
+    printf(1, "dirfull link %s failed after freeing space\n", path);
+    exit();
+  }
+  dirfullcheck("dh", n+1);
+
+  for(i = 0; i <= NPLAIN; i++){
+    dirfullname(path, "dp", i);
+    unlink(path);
+  }
+  for(i = 0; i <= n; i++){
+    dirfullname(path, "dh", i);
+    unlink(path);
+  }
+  if(unlink("dp") != 0 || unlink("dh") != 0 || unlink(file) != 0){
+    printf(1, "dirfull cleanup failed\n");
+    exit();
+  }
+  printf(1, "dirfull ok\n");
+}
+
 void
 subdir(void)
 {
@@ -1200,6 +1877,139 @@ bigfile(void)
   printf(1, "bigfile test ok\n");
 }
 
+// Free blocks in the file system.
+static uint
+freeblocks(void)
+{
+  struct sysinfo info;
+
+  if(getsysinfo(&info) < 0){
+    printf(1, "getsysinfo failed\n");
+    exit();
+  }
+  return info.fs.nfree;
+}
+
+static void
+extwrite(int fd, int i, int tag)
+{
+  int k;
+
+  for(k = 0; k < sizeof(buf)/sizeof(int); k++)
+    ((int*)buf)[k] = (i << 1 | tag) ^ k;
+  if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+    printf(1, "extent test: write %d failed\n", i);
+    exit();
+  }
+}
+
+static void
+extcheck(char *path, int n, int tag)
+{
+  int fd, i, k;
+
+  if((fd = open(path, O_RDONLY)) < 0){
+    printf(1, "extent test: open %s failed\n", path);
+    exit();
+  }
+  for(i = 0; i < n; i++){
+    if(read(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf(1, "extent test: read %s %d failed\n", path, i);
+      exit();
+    }
+    for(k = 0; k < sizeof(buf)/sizeof(int); k++){
+      if(((int*)buf)[k] != ((i << 1 | tag) ^ k)){
+        printf(1, "extent test: %s chunk %d is wrong\n", path, i);
+        exit();
+      }
+    }
+  }
+  if(read(fd, buf, 1) != 0){
+    printf(1, "extent test: %s too long\n", path);
+    exit();
+  }
+  close(fd);
+}
+
+// Write two multi-megabyte files in turns, so that each gets
+// a run per chunk: more than ext[] and the extent block hold,
+// so both go on into the doubly-indirect extent block.  Read
+// them back, check that unlinking them frees every block,
+// then write one again on the freed space.
+void
+extenttest(void)
+{
+  enum { N = 384 };  // chunks of buf: 3 MB a file
+  uint before, used, data;
+  int fd0, fd1, i;
+
+  printf(1, "extent test\n");
+  if(mkdir("xt") != 0){
+    printf(1, "extent test: mkdir failed\n");
+    exit();
+  }
+  before = freeblocks();
+
+  fd0 = open("xt/a", O_CREATE|O_RDWR);
+  fd1 = open("xt/b", O_CREATE|O_RDWR);
+  if(fd0 < 0 || fd1 < 0){
+    printf(1, "extent test: create failed\n");
+    exit();
+  }
+  for(i = 0; i < N; i++){
+    extwrite(fd0, i, 0);
+    extwrite(fd1, i, 1);
+  }
+  close(fd0);
+  close(fd1);
+
+  // Each file needs its extent block, the doubly-indirect
+  // block and at least one extent block listed there.
+  used = before - freeblocks();
+  data = 2 * N * (sizeof(buf) / BSIZE);
+  if(used < data + 6){
+    printf(1, "extent test: %d blocks for %d of data; no dextblock?\n",
+           used, data);
+    exit();
+  }
+  extcheck("xt/a", N, 0);
+  extcheck("xt/b", N, 1);
+
+  if(unlink("xt/a") != 0 || unlink("xt/b") != 0){
+    printf(1, "extent test: unlink failed\n");
+    exit();
+  }
+  if(freeblocks() != before){
+    printf(1, "extent test: %d free blocks after unlink, %d before\n",
+           freeblocks(), before);
+    exit();
+  }
+
+  fd0 = open("xt/a", O_CREATE|O_RDWR);
+  if(fd0 < 0){
+    printf(1, "extent test: create failed\n");
+    exit();
+  }
+  for(i = 0; i < N; i++)
+    extwrite(fd0, i, 1);
+  close(fd0);
+  extcheck("xt/a", N, 1);
+  if(unlink("xt/a") != 0){
+    printf(1, "extent test: unlink failed\n");
+    exit();
+  }
+  if(freeblocks() != before){
+    printf(1, "extent test: %d free blocks after rewrite, %d before\n",
+           freeblocks(), before);
+    exit();
+  }
+  if(unlink("xt") != 0){
+    printf(1, "extent test: cleanup failed\n");
+    exit();
+  }
+  printf(1, "extent test ok\n");
+}
+
 void
 fourteen(void)
 {
@@ -1411,6 +2221,99 @@ forktest(void)
   printf(1, "fork test OK\n");
 }
 
+// fork() shares pages copy-on-write; writes by the child,
+// its own and the kernel's on its behalf, must not reach
+// the parent.
+void
+cowtest(void)
+{
+  int fds[2], pid, i, n;
+  char *a;
+
+  printf(stdout, "cow test\n");
+  n = 64*4096;
+  a = sbrk(n);
+  if(a == (char*)-1){
+    printf(stdout, "cow test sbrk failed\n");
+    exit();
+  }
+  for(i = 0; i < n; i += 4096)
+    a[i] = 'p';
+  if(pipe(fds) != 0){
+    printf(stdout, "cow test pipe failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "cow test fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    for(i = 0; i < n/2; i += 4096)
+      a[i] = 'c';
+    write(fds[1], "k", 1);
+    if(read(fds[0], a + n/2, 1) != 1 || a[n/2] != 'k'){
+      printf(stdout, "cow test child read failed\n");
+      exit();
+    }
+    for(i = 0; i < n; i += 4096){
+      if(a[i] != (i < n/2 ? 'c' : i == n/2 ? 'k' : 'p')){
+        printf(stdout, "cow test child sees wrong data\n");
+        exit();
+      }
+    }
+    exit();
+  }
+  wait();
+  close(fds[0]);
+  close(fds[1]);
+  for(i = 0; i < n; i += 4096){
+    if(a[i] != 'p'){
+      printf(stdout, "cow test parent sees child's write\n");
+      exit();
+    }
+  }
+  sbrk(-n);
+  printf(stdout, "cow test OK\n");
+}
+
+// sbrk() only reserves memory; each page is allocated,
+// zeroed, when it is first touched.
+void
+lazytest(void)
+{
+  struct meminfo m0, m1;
+  char *a;
+  int n;
+
+  printf(stdout, "lazy sbrk test\n");
+  n = 1024*4096;
+  getmeminfo(&m0);
+  a = sbrk(n);
+  if(a == (char*)-1){
+    printf(stdout, "lazy sbrk test sbrk failed\n");
+    exit();
+  }
+  getmeminfo(&m1);
+  if(m0.free_pages - m1.free_pages > 64){
+    printf(stdout, "lazy sbrk test: sbrk allocated %d pages\n",
+           m0.free_pages - m1.free_pages);
+    exit();
+  }
+  if(a[n/2] != 0 || a[n-1] != 0){
+    printf(stdout, "lazy sbrk test: page not zero\n");
+    exit();
+  }
+  a[n-1] = 1;
+  getmeminfo(&m1);
+  if(m1.zero_faults - m0.zero_faults < 2){
+    printf(stdout, "lazy sbrk test: no faults counted\n");
+    exit();
+  }
+  sbrk(-n);
+  printf(stdout, "lazy sbrk test OK\n");
+}
+
 void
 sbrktest(void)
 {
@@ -1762,12 +2665,15 @@ main(int argc, char *argv[])
   concreate();
   fourfiles();
   sharedfd();
+  fsynctest();
+  fsyncconc();
 
   bigargtest();
   bigwrite();
   bigargtest();
   bsstest();
   sbrktest();
+  lazytest();
   validatetest();
 
   opentest();
@@ -1782,21 +2688,30 @@ main(int argc, char *argv[])
   mem();
   pipe1();
   preempt();
+  mlfqtest();
   exitwait();
 
   rmdot();
   fourteen();
   bigfile();
+  extenttest();
   subdir();
   linktest();
   unlinkread();
   dirfile();
   iref();
   forktest();
+  cowtest();
   bigdir(); // slow
+  dirbench(); // slow
+  dirfull(); // slow
 
   uio();
 
+  spawntest();
+  demandtest();
+  pcachetest();
+  texttest();
   exectest();
 
   exit();
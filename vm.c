@@ -6,6 +6,7 @@
 #include "mmu.h"
 #include "proc.h"
 #include "elf.h"
+#include "sysinfo.h"
 
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
@@ -311,39 +312,179 @@ clearpteu(pde_t *pgdir, char *uva)
 }
 
 // Given a parent process's page table, create a copy
-// of it for a child.
+// of it for a child.  The child shares the parent's pages:
+// writable ones become read-only and PTE_COW in both, and
+// pgfault() gives a private copy to the first to write.
 pde_t*
 copyuvm(pde_t *pgdir, uint sz)
 {
   pde_t *d;
   pte_t *pte;
   uint pa, i, flags;
-  char *mem;
 
   if((d = setupkvm()) == 0)
     return 0;
   for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
-      panic("copyuvm: pte should exist");
-    if(!(*pte & PTE_P))
-      panic("copyuvm: page not present");
+    // Pages sbrk() reserved but nothing touched stay so.
+    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0 || !(*pte & PTE_P))
+      continue;
+    if(*pte & PTE_W)
+      *pte = (*pte & ~PTE_W) | PTE_COW;
     pa = PTE_ADDR(*pte);
     flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
-      goto bad;
-    memmove(mem, (char*)P2V(pa), PGSIZE);
-    if(mappages(d, (void*)i, PGSIZE, V2P(mem), flags) < 0) {
-      kfree(mem);
+    if(mappages(d, (void*)i, PGSIZE, pa, flags) < 0)
       goto bad;
-    }
+    kref(P2V(pa));
   }
+  // The parent's TLB may still hold the pages writable.
+  lcr3(V2P(pgdir));
   return d;
 
 bad:
+  lcr3(V2P(pgdir));
   freevm(d);
   return 0;
 }
 
+// Page fault counts, for getmeminfo().
+static struct {
+  uint zero;  // heap pages allocated on first touch
+  uint cow;   // shared pages copied on write
+  uint file;  // program pages read in on first touch
+} faults;
+
+// Map the page of segment s that holds va, which is not
+// yet present.  Pages full of the program file share the
+// page cache's copy, until written; the page where the
+// file's contents end, and any written, are private.
+static int
+segfault(struct proc *p, struct seg *s, uint va, uint err)
+{
+  char *mem, *fpg;
+  uint a, flags;
+
+  if((err & FEC_WR) && !s->writable)
+    return -1;
+  a = PGROUNDDOWN(va);
+  fpg = 0;
+  if(a < s->fend){
+    ilock(p->exe);
+    fpg = pcget(p->exe, s->off + (a - s->va));
+    iunlock(p->exe);
+    if(fpg == 0)
+      return -1;
+    __sync_fetch_and_add(&faults.file, 1);
+  } else
+    __sync_fetch_and_add(&faults.zero, 1);
+
+  if(fpg && a + PGSIZE <= s->fend && !(err & FEC_WR)){
+    mem = fpg;
+    flags = PTE_U | (s->writable ? PTE_COW : 0);
+  } else {
+    if((mem = kalloc()) == 0){
+      if(fpg)
+        kfree(fpg);
+      return -1;
+    }
+    memset(mem, 0, PGSIZE);
+    if(fpg){
+      memmove(mem, fpg, s->fend - a < PGSIZE ? s->fend - a : PGSIZE);
+      kfree(fpg);
+    }
+    flags = PTE_U | (s->writable ? PTE_W : 0);
+  }
+  if(mappages(p->pgdir, (char*)a, PGSIZE, V2P(mem), flags) < 0){
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
+
+// Resolve a page fault at va in the current process.
+// Returns 0 if the faulting instruction may be retried,
+// -1 if the access was not allowed.
+int
+pgfault(uint va, uint err)
+{
+  struct proc *p = myproc();
+  struct seg *s;
+  pte_t *pte;
+  uint pa, flags;
+  char *mem;
+
+  if(va >= p->sz)
+    return -1;
+  pte = walkpgdir(p->pgdir, (char*)va, 0);
+
+  if(pte == 0 || !(*pte & PTE_P)){
+    for(s = p->seg; s < &p->seg[p->nseg]; s++)
+      if(va >= s->va && va < s->end)
+        return segfault(p, s, va, err);
+
+    // A heap page sbrk() reserved that nothing has touched.
+    if((mem = kalloc()) == 0)
+      return -1;
+    memset(mem, 0, PGSIZE);
+    if(mappages(p->pgdir, (char*)PGROUNDDOWN(va), PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
+      kfree(mem);
+      return -1;
+    }
+    __sync_fetch_and_add(&faults.zero, 1);
+    return 0;
+  }
+
+  if(!(err & FEC_WR) || (*pte & (PTE_U|PTE_COW)) != (PTE_U|PTE_COW))
+    return -1;
+
+  // Copy on write.  The last process sharing the
+  // page can take it over.
+  pa = PTE_ADDR(*pte);
+  flags = (PTE_FLAGS(*pte) & ~PTE_COW) | PTE_W;
+  if(krefcount(P2V(pa)) > 1){
+    if((mem = kalloc()) == 0)
+      return -1;
+    memmove(mem, P2V(pa), PGSIZE);
+    *pte = V2P(mem) | flags;
+    kfree(P2V(pa));
+    __sync_fetch_and_add(&faults.cow, 1);
+  } else
+    *pte = pa | flags;
+  lcr3(V2P(p->pgdir));
+  return 0;
+}
+
+// Fault in the current process's pages in [va, va+n), and
+// make them private and writable if write is set, before the
+// kernel uses them, so a system call fails, rather than
+// faulting where it cannot recover, when memory runs out or
+// the pages may not be written.
+int
+uvmready(uint va, uint n, int write)
+{
+  pte_t *pte;
+  uint a;
+
+  for(a = PGROUNDDOWN(va); a < va + n; a += PGSIZE){
+    pte = walkpgdir(myproc()->pgdir, (char*)a, 0);
+    if(pte == 0 || !(*pte & PTE_P)){
+      if(pgfault(a, write ? FEC_WR : 0) < 0)
+        return -1;
+      pte = walkpgdir(myproc()->pgdir, (char*)a, 0);
+    }
+    if(write && !(*pte & PTE_W) && pgfault(a, FEC_WR) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+void
+faultstats(struct meminfo *info)
+{
+  info->zero_faults = faults.zero;
+  info->cow_faults = faults.cow;
+  info->file_faults = faults.file;
+}
+
 //PAGEBREAK!
 // Map user virtual address to kernel address.
 char*